@@ -1,11 +1,71 @@
 #include "rbtree.h"
+#include "rbtree_core.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 
+// -DRBTREE_VALIDATE_EVERY=N 으로 빌드하면 변경 연산 N번마다 rbtree_validate()를 돌려서
+// 불변식이 깨지는 순간 바로 abort 한다. (canary 배포용 debug build)
+#ifdef RBTREE_VALIDATE_EVERY
+static unsigned long rbtree_mutations = 0;
+
+static void rbtree_debug_check(const rbtree *t)
+{
+  if (++rbtree_mutations % RBTREE_VALIDATE_EVERY != 0)
+  {
+    return;
+  }
+  rbtree_check_t r = rbtree_validate(t);
+  if (r != RBTREE_VALID)
+  {
+    fprintf(stderr, "rbtree_validate failed (%d) after %lu mutations\n", (int)r, rbtree_mutations);
+    abort();
+  }
+}
+#define RBTREE_CHECK(t) rbtree_debug_check(t)
+#else
+#define RBTREE_CHECK(t) ((void)0)
+#endif
+
+
+// RBTREE_AUGMENT: 구조가 바뀌는 곳마다 subtree aggregate를 다시 계산
+#ifdef RBTREE_AUGMENT
+#define RBTREE_PULL(x) ((x)->agg = RBTREE_AGG_COMBINE(RBTREE_AGG_COMBINE((x)->left->agg, RBTREE_AGG_OF(x)), (x)->right->agg))
+#else
+#define RBTREE_PULL(x) ((void)0)
+#endif
+
+// x부터 루트까지 올라가며 aggregate 갱신
+static void rbtree_pull_path(rbtree *t, node_t *x)
+{
+#ifdef RBTREE_AUGMENT
+  while (x != t->nil)
+  {
+    RBTREE_PULL(x);
+    x = x->parent;
+  }
+#endif
+}
+
+// 회전/transplant/insert fixup/delete fixup은 rbtree_link.c와 같은 코드를 rbtree_core.h에서 찍어 냄
+// (rbtree_left_rotate, rbtree_right_rotate, rbtree_transplant, rbtree_insert_fixup, rbtree_erase_fixup, rbtree_detach)
+#define RBTREE_LEAF(t) ((t)->nil)
+#define RBTREE_ROOT(t) ((t)->root)
+#define RBTREE_PULL_NODE(t, x) RBTREE_PULL(x)
+RB_CORE_DEFINE(rbtree, rbtree, node_t, RBTREE_LEAF, RBTREE_ROOT, RBTREE_PULL_NODE, rbtree_pull_path)
 
 
 rbtree *new_rbtree(void) {
+  return new_rbtree_mode(0);
+}
+
+rbtree *new_rbtree_mode(const unsigned int mode) {
 
   rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));     // rbtree를 위한 메모리 할당
   
@@ -58,155 +118,564 @@ rbtree *new_rbtree(void) {
   p->nil->left =  NULL; 
   p->nil->right =  NULL;
   p->nil->parent =  NULL;                            // nil 노드의 부모를 자기 자신으로 설정 (또는 NULL을 가리기케 하는 방법도 있음)
+#ifdef RBTREE_AUGMENT
+  p->nil->agg = RBTREE_AGG_IDENTITY;                 // 빈 subtree의 aggregate는 항등원
+#endif
 
 
   // 루트 노드 초기화
   p->root = p->nil;
+  p->min = p->max = p->nil;
+  p->pool.cursor = p->nil;
+  p->mode = (mode & RBTREE_MODE_HUGEPAGE) ? (mode | RBTREE_MODE_ARENA) : mode;
   return p;
 }
 
 
-int rbtree_left_rotate(rbtree *t, node_t *x)
+// RBTREE_MODE_INDEXED: key -> node hash index (open addressing, linear probing)
+// 같은 key가 여러 개면 그 중 아무 노드 하나만 가리킨다.
+#define RBTREE_INDEX_MIN 16
+
+static size_t rbtree_index_hash(const rbtree_index *ix, const key_t key)
 {
-  node_t *y = x->right;                   // y에 x의 오른쪽 자식 노드 주소를 저장
-  x->right = y->left;                     // x의 오른쪽 자식을 y의 왼쪽 자식으로 연결
+  // Fibonacci hashing: 곱한 결과의 상위 비트를 slot 번호로 사용
+  return (size_t)(((unsigned long long)(unsigned int)key * 0x9E3779B97F4A7C15ull) >> ix->shift);
+}
 
-  if (y->left != t->nil)                  // y의 왼쪽 자식이 NIL 노드가 아니라면
+// key가 들어 있는 slot (없으면 NULL)
+static rbtree_index_slot *rbtree_index_probe(const rbtree *t, const key_t key)
+{
+  const rbtree_index *ix = &t->index;
+  if (ix->used == 0)
+  {
+    return NULL;
+  }
+  const size_t mask = ix->cap - 1;
+  for (size_t i = rbtree_index_hash(ix, key); ix->slots[i].node != NULL; i = (i + 1) & mask)
   {
-    y->left->parent = x;                  // y의 왼쪽 자식 노드를 x와 연결
+    if (ix->slots[i].key == key)
+    {
+      return &ix->slots[i];
+    }
   }
+  return NULL;
+}
+
+static void rbtree_index_resize(rbtree *t, const size_t cap)
+{
+  rbtree_index *ix = &t->index;
+  rbtree_index_slot *old = ix->slots;
+  const size_t old_cap = ix->cap;
 
-  y->parent = x->parent;                  // y를 x의 부모 노드에 연결
-  if (x->parent == t->nil)                // x의 부모가 NIL 노드라면 (루트 노드라면)
+  ix->slots = (rbtree_index_slot *)calloc(cap, sizeof(rbtree_index_slot));
+  if (ix->slots == NULL)
   {
-    t->root = y;                          // 트리의 루트를 y로 변경
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
   }
-  else if (x == x->parent->left)          // x가 부모의 왼쪽 자식 노드라면
+  ix->cap = cap;
+  ix->shift = 64;
+  for (size_t c = cap; c > 1; c >>= 1)
   {
-    x->parent->left = y;                  // y를 부모의 왼쪽 자식으로 연결
+    ix->shift--;
   }
-  else                                    // x가 부모의 오른쪽 자식 노드라면
+  for (size_t i = 0; i < old_cap; i++)   // 기존 항목을 새 table에 다시 배치
   {
-    x->parent->right = y;                 // y를 부모의 오른쪽 자식으로 연결
+    if (old[i].node == NULL)
+    {
+      continue;
+    }
+    size_t j = rbtree_index_hash(ix, old[i].key);
+    while (ix->slots[j].node != NULL)
+    {
+      j = (j + 1) & (cap - 1);
+    }
+    ix->slots[j] = old[i];
   }
-
-  y->left = x;                            // x를 y의 왼쪽 자식으로 연결
-  x->parent = y;                          // y를 x의 부모로 연결
-  
-  return 0;
+  free(old);
 }
 
-int rbtree_right_rotate(rbtree *t, node_t *x)
+// z의 key가 아직 없을 때만 추가 (이미 같은 key의 노드가 있으면 그대로 둠)
+static void rbtree_index_add(rbtree *t, node_t *z)
 {
-  node_t *y = x->left;                    // y에 x의 왼쪽 자식 노드 주소를 저장
-  x->left = y->right;                     // x의 왼쪽 자식을 y의 오른쪽 자식으로 연결
-  if (y->right != t->nil)                 // y의 오른쪽 자식이 NIL 노드가 아니라면
+  rbtree_index *ix = &t->index;
+  if ((ix->used + 1) * 10 > ix->cap * 7)  // load factor 0.7을 넘기 전에 2배로
   {
-    y->right->parent = x;                 // y의 오른쪽 자식 노드를 x와 연결
+    rbtree_index_resize(t, ix->cap == 0 ? RBTREE_INDEX_MIN : ix->cap * 2);
   }
-
-  // 여기부터 아래까지는 LEFT_ROTATE와 코드 동일
-  y->parent = x->parent;                             
-  if (x->parent == t->nil)
+  const size_t mask = ix->cap - 1;
+  size_t i = rbtree_index_hash(ix, z->key);
+  while (ix->slots[i].node != NULL)
   {
-    t->root = y;
+    if (ix->slots[i].key == z->key)
+    {
+      return;
+    }
+    i = (i + 1) & mask;
   }
-  else if (x == x->parent->left)
+  ix->slots[i].key = z->key;
+  ix->slots[i].node = z;
+  ix->used++;
+}
+
+static void rbtree_index_remove(rbtree *t, const key_t key)
+{
+  rbtree_index *ix = &t->index;
+  rbtree_index_slot *slot = rbtree_index_probe(t, key);
+  if (slot == NULL)
   {
-    x->parent->left = y;
+    return;
   }
-  else
-  { 
-    x->parent->right = y;
+  // backward shift deletion: 빈 칸 뒤의 항목들 중 원래 자리(home)에서 빈 칸을 지나쳐 온 것을 당겨 옴
+  // (tombstone이 없으므로 삭제가 많아도 탐색 길이가 늘지 않음)
+  const size_t mask = ix->cap - 1;
+  size_t i = (size_t)(slot - ix->slots);
+  for (size_t j = (i + 1) & mask; ix->slots[j].node != NULL; j = (j + 1) & mask)
+  {
+    size_t home = rbtree_index_hash(ix, ix->slots[j].key);
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      ix->slots[i] = ix->slots[j];
+      i = j;
+    }
   }
+  ix->slots[i].node = NULL;
+  ix->used--;
 
-  y->right = x;
-  x->parent = y;
+  if (ix->used == 0)                    // 비면 table을 반환
+  {
+    free(ix->slots);
+    memset(ix, 0, sizeof(rbtree_index));
+  }
+  else if (ix->cap > RBTREE_INDEX_MIN && ix->used * 8 < ix->cap)
+  {
+    rbtree_index_resize(t, ix->cap / 2);
+  }
+}
 
-  return 0;
+size_t rbtree_index_memory(const rbtree *t)
+{
+  return t->index.cap * sizeof(rbtree_index_slot);
 }
 
 
+// 노드를 담는 slab pool. rbtree_compact가 노드를 옮겨 담고, RBTREE_MODE_ARENA에서는 insert도 여기서 할당한다.
+// 앞에서부터 차례로(bump) 채우고, 반환된 자리는 slab별 free list로 재사용하며, live가 0이 되면 slab째로 반환
+#ifndef RBTREE_SLAB_NODES
+#define RBTREE_SLAB_NODES 1024
+#endif
+#define RBTREE_HUGE_PAGE ((size_t)2 << 20)
+
+enum { RBTREE_SLAB_HEAP, RBTREE_SLAB_MMAP, RBTREE_SLAB_HUGETLB };
+
+struct rbtree_slab {
+  size_t used;   // 지금까지 bump로 나눠 준 node 수
+  size_t live;   // 아직 트리에 있는 node 수
+  node_t *free;  // 반환된 자리들 (right로 연결)
+  struct rbtree_slab *prev_partial, *next_partial;  // free가 있는 slab들의 목록
+  size_t bytes;  // slab 전체 크기 (header 포함)
+  int backing;   // RBTREE_SLAB_HEAP/MMAP/HUGETLB
+  int huge;      // huge page 위에 있음 (HUGETLB 또는 THP 요청)
+  int placed;    // NUMA 정책이 적용됨 (정책이 DEFAULT이거나 mbind 성공)
+  node_t nodes[];
+};
+
+// slab 하나에 들어가는 node 수: huge page mode면 2MB 한 장을 꽉 채움
+static size_t rbtree_slab_nodes(const unsigned int mode)
+{
+  if (mode & RBTREE_MODE_HUGEPAGE)
+  {
+    return (RBTREE_HUGE_PAGE - sizeof(struct rbtree_slab)) / sizeof(node_t);
+  }
+  return RBTREE_SLAB_NODES;
+}
+
+// mmap으로 잡은 page들에 NUMA 배치 정책 적용, 성공하면 0
+static int rbtree_slab_bind(void *p, const size_t bytes, const rbtree_numa_t policy, unsigned long nodes, const unsigned int flags)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  const int local = policy == RBTREE_NUMA_DEFAULT || policy == RBTREE_NUMA_LOCAL;
+  // maxnode는 mask의 bit 수 + 1 (kernel이 하나 빼고 읽음)
+  return (int)syscall(SYS_mbind, p, bytes, policy, local ? NULL : &nodes,
+                      local ? 0 : sizeof(nodes) * 8 + 1, flags);
+#else
+  (void)p; (void)bytes; (void)policy; (void)nodes; (void)flags;
+  return -1;
+#endif
+}
 
-void rbtree_insert_fixup(rbtree *t, node_t *z)
+// slab 메모리 확보: huge page mode면 MAP_HUGETLB -> 2MB 정렬 mmap + MADV_HUGEPAGE -> malloc 순으로 시도
+// NUMA 정책이 있으면 mmap으로 잡아서 mbind, mbind가 실패하거나 malloc으로 떨어지면 placed = 0
+static struct rbtree_slab *rbtree_slab_map(const rbtree *t)
 {
-  while (z->parent->color == RBTREE_RED)
+  const size_t want = sizeof(struct rbtree_slab) + t->pool.slab_nodes * sizeof(node_t);
+  void *p = NULL;
+  size_t bytes = want;
+  int backing = RBTREE_SLAB_HEAP, huge = 0;
+  int placed = t->pool.numa_policy == RBTREE_NUMA_DEFAULT;
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+  const int hugepage = (t->mode & RBTREE_MODE_HUGEPAGE) != 0;
+  if (hugepage || t->pool.numa_policy != RBTREE_NUMA_DEFAULT)
   {
-    // 부모가 할아버지의 왼쪽에 있을 때
-    if (z->parent == z->parent->parent->left)
+    const size_t align = hugepage ? RBTREE_HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    bytes = (want + align - 1) / align * align;
+#ifdef MAP_HUGETLB
+    if (hugepage)                   // 미리 예약된 (hugetlbfs) huge page
     {
-      node_t *y = z->parent->parent->right;
-      if (y->color == RBTREE_RED) // Case 1: 삼촌 y가 RED
+      p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
       {
-        // Case 1: Recoloring
-        z->parent->color = RBTREE_BLACK;
-        y->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        z = z->parent->parent;
+        p = NULL;
       }
       else
       {
-        if (z == z->parent->right) // Case 2: z가 오른쪽 자식인 경우
-        {
-          z = z->parent;
-          rbtree_left_rotate(t, z); // 왼쪽 회전으로 Case 3로 변환
-        }
-        // Case 3: z가 왼쪽 자식인 경우
-        z->parent->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        rbtree_right_rotate(t, z->parent->parent);
+        backing = RBTREE_SLAB_HUGETLB;
+        huge = 1;
       }
     }
-    else // 부모가 할아버지의 오른쪽에 있을 때 (위와 대칭)
+#endif
+    if (p == NULL)                  // 보통 page로 align 만큼 더 잡아서 경계를 맞추고 남는 앞뒤는 돌려줌
     {
-      node_t *y = z->parent->parent->left;
-      if (y->color == RBTREE_RED)
-      {
-        z->parent->color = RBTREE_BLACK;
-        y->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        z = z->parent->parent;
-      }
-      else
+      char *raw = (char *)mmap(NULL, bytes + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw != (char *)MAP_FAILED)
       {
-        if (z == z->parent->left)
+        char *start = (char *)(((unsigned long)raw + align - 1) & ~(unsigned long)(align - 1));
+        if (start > raw)
+        {
+          munmap(raw, (size_t)(start - raw));
+        }
+        if (raw + align > start)
+        {
+          munmap(start + bytes, (size_t)(raw + align - start));
+        }
+#ifdef MADV_HUGEPAGE
+        if (hugepage)               // transparent huge page 요청 (안 되면 보통 page로 동작)
         {
-          z = z->parent;
-          rbtree_right_rotate(t, z);
+          huge = madvise(start, bytes, MADV_HUGEPAGE) == 0;
         }
-        z->parent->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        rbtree_left_rotate(t, z->parent->parent);
+#endif
+        p = start;
+        backing = RBTREE_SLAB_MMAP;
       }
     }
+    if (p != NULL && t->pool.numa_policy != RBTREE_NUMA_DEFAULT)
+    {
+      placed = rbtree_slab_bind(p, bytes, t->pool.numa_policy, t->pool.numa_nodes, 0) == 0;
+    }
+  }
+#endif
+  if (p == NULL)
+  {
+    p = malloc(want);
+    bytes = want;
+    backing = RBTREE_SLAB_HEAP;
+    huge = 0;
+    placed = t->pool.numa_policy == RBTREE_NUMA_DEFAULT;
+  }
+  if (p == NULL)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  struct rbtree_slab *s = (struct rbtree_slab *)p;
+  s->used = s->live = 0;
+  s->free = NULL;
+  s->prev_partial = s->next_partial = NULL;
+  s->bytes = bytes;
+  s->backing = backing;
+  s->huge = huge;
+  s->placed = placed;
+  return s;
+}
+
+static void rbtree_slab_unmap(struct rbtree_slab *s)
+{
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+  if (s->backing != RBTREE_SLAB_HEAP)
+  {
+    munmap(s, s->bytes);
+    return;
   }
-  t->root->color = RBTREE_BLACK; // 루트는 항상 BLACK
+#endif
+  free(s);
 }
 
+// x가 들어 있는 slab의 위치 (pool 밖에서 malloc된 노드면 -1), slab 주소 순으로 이분 탐색
+static long rbtree_pool_find(const rbtree *t, const node_t *x)
+{
+  const rbtree_pool *pool = &t->pool;
+  size_t lo = 0, hi = pool->nslabs;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    const struct rbtree_slab *s = pool->slabs[mid];
+    if (x < s->nodes)
+    {
+      hi = mid;
+    }
+    else if (x >= s->nodes + pool->slab_nodes)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      return (long)mid;
+    }
+  }
+  return -1;
+}
 
+static void rbtree_partial_unlink(rbtree *t, struct rbtree_slab *s)
+{
+  if (s->prev_partial != NULL)
+  {
+    s->prev_partial->next_partial = s->next_partial;
+  }
+  else if (t->pool.partial == s)
+  {
+    t->pool.partial = s->next_partial;
+  }
+  if (s->next_partial != NULL)
+  {
+    s->next_partial->prev_partial = s->prev_partial;
+  }
+  s->prev_partial = s->next_partial = NULL;
+}
 
-node_t *rbtree_insert(rbtree *t, const key_t key) {
-  // TODO: implement insert
+// i번째 slab을 목록에서 빼고 반환
+static void rbtree_pool_release(rbtree *t, const size_t i)
+{
+  rbtree_pool *pool = &t->pool;
+  struct rbtree_slab *s = pool->slabs[i];
+  pool->nslabs--;
+  for (size_t j = i; j < pool->nslabs; j++)
+  {
+    pool->slabs[j] = pool->slabs[j + 1];
+  }
+  if (pool->active == s)
+  {
+    pool->active = NULL;
+  }
+  rbtree_partial_unlink(t, s);
+  pool->bytes -= s->bytes;
+  pool->reclaimed += s->bytes;
+  rbtree_slab_unmap(s);
+}
 
-  node_t *z = (node_t *)calloc(1, sizeof(node_t));     // node_t 위한 메모리 할당
-  printf("%p",z);
-  // node_t를 위한 메모리 할당 실패 시 예외 처리
-  if (z == NULL)
+static struct rbtree_slab *rbtree_pool_grow(rbtree *t)
+{
+  rbtree_pool *pool = &t->pool;
+  if (pool->active != NULL && pool->active->live == 0)  // 채우던 slab이 이미 비어 있으면 먼저 반환
   {
-        fprintf(stderr, "Memory allocation failed\n"); // stderr: 표준 에러 출력 스트림
-        exit(EXIT_FAILURE);   
+    rbtree_pool_release(t, (size_t)rbtree_pool_find(t, pool->active->nodes));
+  }
+  if (pool->slab_nodes == 0)
+  {
+    pool->slab_nodes = rbtree_slab_nodes(t->mode);
+  }
+  struct rbtree_slab *s = rbtree_slab_map(t);
+  if (pool->nslabs == pool->cap)
+  {
+    pool->cap = pool->cap == 0 ? 8 : pool->cap * 2;
+    pool->slabs = (struct rbtree_slab **)realloc(pool->slabs, pool->cap * sizeof(struct rbtree_slab *));
+    if (pool->slabs == NULL)
+    {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  size_t i = pool->nslabs++;        // 주소 순서를 유지하며 끼워 넣음
+  while (i > 0 && pool->slabs[i - 1] > s)
+  {
+    pool->slabs[i] = pool->slabs[i - 1];
+    i--;
+  }
+  pool->slabs[i] = s;
+  pool->bytes += s->bytes;
+  pool->active = s;
+  return s;
+}
+
+// compaction용: 항상 active slab의 뒤쪽 빈자리에 붙여서 옮긴 순서대로 연속되게 함
+static node_t *rbtree_pool_alloc(rbtree *t)
+{
+  struct rbtree_slab *s = t->pool.active;
+  if (s == NULL || s->used == t->pool.slab_nodes)
+  {
+    s = rbtree_pool_grow(t);
+  }
+  s->live++;
+  return &s->nodes[s->used++];
+}
+
+// arena mode의 insert용: active slab의 빈자리, 반환된 자리, 새 slab 순으로 사용
+static node_t *rbtree_arena_alloc(rbtree *t)
+{
+  rbtree_pool *pool = &t->pool;
+  struct rbtree_slab *s = pool->active;
+  if ((s == NULL || s->used == pool->slab_nodes) && pool->partial != NULL)
+  {
+    s = pool->partial;
+    node_t *x = s->free;
+    s->free = x->right;
+    if (s->free == NULL)
+    {
+      rbtree_partial_unlink(t, s);
+    }
+    s->live++;
+    return x;
+  }
+  return rbtree_pool_alloc(t);
+}
+
+// 노드 메모리 반환: pool의 노드면 slab의 free list에 넣고 비면 slab째로 반환, 아니면 free
+static void rbtree_free_node(rbtree *t, node_t *x)
+{
+  rbtree_pool *pool = &t->pool;
+  long i = pool->nslabs == 0 ? -1 : rbtree_pool_find(t, x);
+  if (i < 0)
+  {
+    free(x);
+    pool->heap_nodes--;
+    pool->reclaimed += sizeof(node_t);
+    return;
+  }
+  struct rbtree_slab *s = pool->slabs[i];
+  if (--s->live == 0 && s != pool->active)
+  {
+    rbtree_pool_release(t, (size_t)i);
+    return;
+  }
+  if (s->free == NULL)
+  {
+    s->next_partial = pool->partial;
+    if (pool->partial != NULL)
+    {
+      pool->partial->prev_partial = s;
+    }
+    pool->partial = s;
+  }
+  x->right = s->free;
+  s->free = x;
+}
+
+int rbtree_set_numa(rbtree *t, const rbtree_numa_t policy, const unsigned long nodes)
+{
+  // node mask가 의미 없는 정책에 mask를 주거나 범위 밖의 정책이면 거부
+  if (policy < RBTREE_NUMA_DEFAULT || policy > RBTREE_NUMA_LOCAL ||
+      ((policy == RBTREE_NUMA_DEFAULT || policy == RBTREE_NUMA_LOCAL) && nodes != 0))
+  {
+    return -1;
+  }
+#if defined(__linux__) && defined(SYS_mbind) && defined(MAP_ANONYMOUS)
+  // 빈 page 하나에 먼저 mbind해서 kernel이 정책과 mask (없는 node, cpuset 밖 등)를 받아 주는지 확인
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  void *probe = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (probe == MAP_FAILED)
+  {
+    return -1;
+  }
+  const int ok = rbtree_slab_bind(probe, page, policy, nodes, 0) == 0;
+  munmap(probe, page);
+  if (!ok)
+  {
+    return -1;                      // 이전 정책 유지
+  }
+
+  // 앞으로 만드는 slab에 적용하고, 이미 mmap된 slab은 MPOL_MF_MOVE로 page를 옮겨 달라고 요청
+  // malloc으로 잡은 slab은 옮길 수 없으므로 DEFAULT가 아니면 배치 실패로 남음
+  t->pool.numa_policy = policy;
+  t->pool.numa_nodes = nodes;
+  int r = 0;
+  for (size_t i = 0; i < t->pool.nslabs; i++)
+  {
+    struct rbtree_slab *s = t->pool.slabs[i];
+    if (s->backing == RBTREE_SLAB_HEAP)
+    {
+      s->placed = policy == RBTREE_NUMA_DEFAULT;
+    }
+    else
+    {
+      s->placed = rbtree_slab_bind(s, s->bytes, policy, nodes, 2 /* MPOL_MF_MOVE */) == 0;
+    }
+    if (!s->placed)
+    {
+      r = -1;
+    }
+  }
+  return r;
+#else
+  (void)t;
+  return -1;
+#endif
+}
+
+void rbtree_memory_usage(const rbtree *t, rbtree_memory *m)
+{
+  const rbtree_pool *pool = &t->pool;
+  size_t slab_live = 0;
+  memset(m, 0, sizeof(rbtree_memory));
+  for (size_t i = 0; i < pool->nslabs; i++)
+  {
+    const struct rbtree_slab *s = pool->slabs[i];
+    slab_live += s->live;
+    m->huge_bytes += s->huge ? s->bytes : 0;
+    m->unplaced_bytes += s->placed ? 0 : s->bytes;
+  }
+  m->slabs = pool->nslabs;
+  m->slab_bytes = pool->bytes;
+  m->nodes = (pool->heap_nodes + slab_live) * sizeof(node_t);
+  // malloc한 node마다 붙는 allocator header는 여기서 알 수 없으므로 빠져 있음
+  m->overhead = sizeof(rbtree) + sizeof(node_t) + rbtree_index_memory(t)
+              + pool->cap * sizeof(struct rbtree_slab *) + pool->nslabs * sizeof(struct rbtree_slab);
+  m->fragmentation = pool->bytes - pool->nslabs * sizeof(struct rbtree_slab) - slab_live * sizeof(node_t);
+}
+
+
+static node_t *rbtree_new_node(rbtree *t, const key_t key)
+{
+  node_t *z;
+  if (t->mode & RBTREE_MODE_ARENA)
+  {
+    z = rbtree_arena_alloc(t);
+    memset(z, 0, sizeof(node_t));
+  }
+  else
+  {
+    z = (node_t *)calloc(1, sizeof(node_t));     // node_t 위한 메모리 할당
+    // node_t를 위한 메모리 할당 실패 시 예외 처리
+    if (z == NULL)
+    {
+          fprintf(stderr, "Memory allocation failed\n"); // stderr: 표준 에러 출력 스트림
+          exit(EXIT_FAILURE);   
+    }
+    t->pool.heap_nodes++;
   }
   
   // 새롭게 삽입할 노드의 key 설정
   z->key = key;
+  z->count = 1;
+  return z;
+}
 
-  node_t *y = t->nil;
-  node_t *x = t->root;
+// x를 root로 하는 subtree에서 key가 들어갈 자리의 부모 노드를 찾는다.
+static node_t *rbtree_insert_parent(const rbtree *t, node_t *x, const key_t key)
+{
+  // 오름차순 append: 캐시된 최대 노드의 오른쪽이 곧 들어갈 자리 (루트부터 내려가도 같은 자리에 도착)
+  if (t->max != t->nil && key >= t->max->key)
+  {
+    return t->max;
+  }
+  if (t->min != t->nil && key < t->min->key)
+  {
+    return t->min;
+  }
 
+  node_t *y = t->nil;
   while (x != t->nil)
   {
     y = x;                      // 반복문 첫 번째 시행 시, z의 부모 노드는 잠정적으로 루트 노드인 x
-    if (z->key < x->key)
+    if (key < x->key)
     {
       x = x->left;              // pointer를 x의 left로 변경
     }
@@ -215,33 +684,135 @@ node_t *rbtree_insert(rbtree *t, const key_t key) {
       x = x->right;             // pointer를 x의 right로 변경
     }
   }
+  return y;
+}
 
+// z를 y의 자식으로 연결하고 색을 맞춘다. (y가 nil이면 z가 루트)
+static void rbtree_insert_at(rbtree *t, node_t *y, node_t *z)
+{
   z->parent = y;
   if (y == t->nil)
   {
     t->root = z;
+    t->min = t->max = z;
   }
   else if (z->key < y->key)
   {
     y->left = z;
+    if (y == t->min)            // 최소 노드의 왼쪽에 붙으면 새 최소
+    {
+      t->min = z;
+    }
   }
   else 
   {
     y->right = z;
+    if (y == t->max)            // 최대 노드의 오른쪽에 붙으면 새 최대
+    {
+      t->max = z;
+    }
   }
 
   z->left = t->nil;
   z->right = t->nil;
   z->color = RBTREE_RED;
+  t->size += z->count;
+  rbtree_pull_path(t, z);
+  if (t->mode & RBTREE_MODE_INDEXED)
+  {
+    rbtree_index_add(t, z);
+  }
 
   rbtree_insert_fixup(t, z);
-  
+  RBTREE_CHECK(t);
+}
+
+// counted mode에서 이미 있는 key면 개수만 올린다.
+static node_t *rbtree_bump(rbtree *t, node_t *p)
+{
+  if (p->count == RBTREE_COUNT_MAX)   // count는 color와 같은 word의 31 bit
+  {
+    fprintf(stderr, "rbtree: more than %u copies of key %d\n", RBTREE_COUNT_MAX, p->key);
+    exit(EXIT_FAILURE);
+  }
+  p->count++;
+  t->size++;
+  rbtree_pull_path(t, p);
+  RBTREE_CHECK(t);
+  return p;
+}
+
+static node_t *rbtree_insert_evict(rbtree *t, const key_t key);  // capacity가 찼을 때 (아래 rbtree_erase 근처)
+
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  if (t->capacity != 0 && t->size >= t->capacity)
+  {
+    return rbtree_insert_evict(t, key);
+  }
+  if (t->mode & RBTREE_MODE_COUNTED)
+  {
+    node_t *p = rbtree_find(t, key);
+    if (p != NULL)
+    {
+      return rbtree_bump(t, p);
+    }
+  }
+  node_t *z = rbtree_new_node(t, key);
+  rbtree_insert_at(t, rbtree_insert_parent(t, t->root, key), z);
   return z;
 }
 
+// finger에서 부모 방향으로, key가 들어갈 수 있는 가장 낮은 subtree의 root까지만 올라간다.
+// finger와 key 사이의 거리가 d이면 O(log d)개의 조상만 거친다.
+static node_t *rbtree_climb(const rbtree *t, node_t *x, const key_t key)
+{
+  if (key >= x->key)
+  {
+    // 아래쪽 경계는 이미 만족하므로 key 이상인 위쪽 경계(왼쪽 자식으로 매달린 조상)가 나올 때까지 올라감
+    while (x->parent != t->nil && (x == x->parent->right || x->parent->key < key))
+    {
+      x = x->parent;
+    }
+  }
+  else
+  {
+    while (x->parent != t->nil && (x == x->parent->left || x->parent->key > key))
+    {
+      x = x->parent;
+    }
+  }
+  return x;
+}
+
+node_t *rbtree_insert_hint(rbtree *t, node_t *hint, const key_t key) {
+  if (hint == NULL || hint == t->nil || (t->capacity != 0 && t->size >= t->capacity))
+  {
+    return rbtree_insert(t, key);
+  }
+  // 최대값 초과/최소값 미만이면 캐시된 max/min 옆이 들어갈 자리이므로 hint에서 올라갈 필요가 없음
+  // (hint가 방금 넣은 max일 때 climb하면 오른쪽 가장자리를 따라 루트까지 올라감)
+  const int outside = key > t->max->key || key < t->min->key;
+  if (t->mode & RBTREE_MODE_COUNTED)
+  {
+    node_t *p = outside ? NULL : rbtree_find_from(t, hint, key);
+    if (p != NULL)
+    {
+      return rbtree_bump(t, p);
+    }
+  }
+  node_t *z = rbtree_new_node(t, key);
+  node_t *from = (outside || key == t->max->key) ? t->root : rbtree_climb(t, hint, key);
+  rbtree_insert_at(t, rbtree_insert_parent(t, from, key), z);
+  return z;
+}
 
 
 node_t *rbtree_find(const rbtree *t, const key_t key) {
+  if (t->mode & RBTREE_MODE_INDEXED)   // hash index가 있으면 트리를 내려가지 않음
+  {
+    rbtree_index_slot *slot = rbtree_index_probe(t, key);
+    return slot == NULL ? NULL : slot->node;
+  }
   node_t *nil = t->nil;
   node_t *cur = t->root;
   while(cur != nil) {
@@ -256,42 +827,168 @@ node_t *rbtree_find(const rbtree *t, const key_t key) {
   return NULL;
 }
 
-
-
-
-
-void freeNode(node_t *node, rbtree *t) {
-    if (node == t->nil) {
-        return;
+node_t *rbtree_find_from(const rbtree *t, node_t *finger, const key_t key) {
+  if (finger == NULL || finger == t->nil || (t->mode & RBTREE_MODE_INDEXED))
+  {
+    return rbtree_find(t, key);
+  }
+  // rbtree_climb과 같지만 경계가 key와 같은 조상을 만나면 그 조상이 답이다.
+  node_t *nil = t->nil;
+  node_t *cur = finger;
+  if (key > cur->key)
+  {
+    while (cur->parent != nil && (cur == cur->parent->right || cur->parent->key <= key))
+    {
+      cur = cur->parent;
+      if (cur->key == key)
+      {
+        return cur;
+      }
     }
-    freeNode(node->left, t);
-    freeNode(node->right, t);
-    free(node);
-  return;
-}
-void delete_rbtree(rbtree *t) {
+  }
+  else if (key < cur->key)
+  {
+    while (cur->parent != nil && (cur == cur->parent->left || cur->parent->key >= key))
+    {
+      cur = cur->parent;
+      if (cur->key == key)
+      {
+        return cur;
+      }
+    }
+  }
+  while(cur != nil) {
+    if (cur->key == key) {
+      return cur;
+    } else if (cur->key > key) {
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return NULL;
+}
+
+
+// 한 번에 같이 내려가는 탐색의 개수 (그룹 크기)
+#ifndef RBTREE_FIND_GROUP
+#define RBTREE_FIND_GROUP 16
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define rbtree_prefetch(p) __builtin_prefetch((p), 0, 3)
+#else
+#define rbtree_prefetch(p) ((void)(p))
+#endif
+
+size_t rbtree_find_many(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+  // 여러 key의 탐색을 한 레벨씩 번갈아 진행하면서 다음 노드를 미리 prefetch 해 둔다.
+  // 한 탐색이 cache miss를 기다리는 동안 다른 탐색들이 진행되므로 miss latency가 겹쳐서 숨겨진다.
+  // 결과는 key 마다 rbtree_find를 부른 것과 같다.
+  node_t *nil = t->nil;
+  node_t *cur[RBTREE_FIND_GROUP];
+  size_t lane[RBTREE_FIND_GROUP];   // 아직 탐색 중인 key들의 인덱스
+  size_t found = 0;
+
+  if (t->mode & RBTREE_MODE_INDEXED)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = rbtree_find(t, keys[i]);
+      found += (out[i] != NULL);
+    }
+    return found;
+  }
+
+  // 처음 RBTREE_FIND_GROUP개의 key로 lane을 채우고, 탐색이 끝난 lane에는 바로 다음 key를 넣는다
+  // (rolling window). 입력이 남아 있는 동안은 항상 RBTREE_FIND_GROUP개의 탐색이 동시에 진행된다.
+  size_t next = 0, active = 0;
+  while (active < RBTREE_FIND_GROUP && next < n) {
+    lane[active] = next++;
+    cur[active] = t->root;
+    active++;
+  }
+
+  while (active > 0) {
+    size_t i = 0;
+    while (i < active) {
+      node_t *x = cur[i];
+      const key_t key = keys[lane[i]];
+      if (x == nil || x->key == key) {
+        out[lane[i]] = (x == nil) ? NULL : x;
+        found += (x != nil);
+        if (next < n) {                 // 끝난 lane에 다음 key를 넣어 루트부터 다시 시작
+          lane[i] = next++;
+          cur[i] = t->root;
+          i++;
+          continue;
+        }
+        active--;                       // 남은 key가 없으면 마지막 lane과 자리를 바꿔서 제거
+        lane[i] = lane[active];
+        cur[i] = cur[active];
+        continue;
+      }
+      x = (x->key > key) ? x->left : x->right;
+      rbtree_prefetch(x);               // 다음 라운드에서 읽을 노드를 미리 요청
+      cur[i] = x;
+      i++;
+    }
+  }
+  return found;
+}
+
+
+
+
+
+// x subtree의 노드를 재귀 없이 한 번에 반환하고, 반환한 key의 개수(count 합)를 돌려준다.
+// 왼쪽 자식이 있으면 오른쪽으로 회전시켜 한 줄(vine)로 펴면서 왼쪽 자식이 없는 노드부터 free
+size_t freeNode(node_t *x, rbtree *t) {
+  size_t removed = 0;
+  while (x != t->nil) {
+    if (x->left != t->nil) {
+      node_t *l = x->left;
+      x->left = l->right;
+      l->right = x;
+      x = l;
+    } else {
+      node_t *next = x->right;
+      removed += x->count;
+      if (t->mode & RBTREE_MODE_INDEXED)  // 지우는 구간의 key는 모두 사라지므로 index에서도 제거
+      {
+        rbtree_index_remove(t, x->key);
+      }
+      if (x == t->pool.cursor)            // 구간째 지울 때는 호출한 쪽에서 cursor를 다시 잡음
+      {
+        t->pool.cursor = t->nil;
+      }
+      rbtree_free_node(t, x);
+      x = next;
+    }
+  }
+  return removed;
+}
+void delete_rbtree(rbtree *t) {
+  free(t->index.slots);
+  t->mode &= ~RBTREE_MODE_INDEXED;     // 어차피 다 지우므로 freeNode가 index를 고치지 않게 함
   freeNode(t->root, t);
+  for (size_t i = 0; i < t->pool.nslabs; i++)  // 비어도 남겨 두는 active slab 등
+  {
+    rbtree_slab_unmap(t->pool.slabs[i]);
+  }
+  free(t->pool.slabs);
   free(t->nil);
   free(t);
 }
 
 
 node_t *rbtree_min(const rbtree *t) {
-  node_t *ptr = t->root;
-  // 루트에서 왼쪽 자식으로 계속 이동하여 가장 왼쪽 노드를 찾음
-  while (ptr->left != t->nil) {
-    ptr = ptr->left;
-  }
-  return ptr;  // 가장 왼쪽 노드가 최소값을 가짐
+  // 삽입/삭제 때마다 갱신해 두는 최소 노드를 그대로 반환 (빈 트리면 NULL)
+  return t->min == t->nil ? NULL : t->min;
 }
 
 node_t *rbtree_max(const rbtree *t) {
-  node_t *ptr = t->root;
-  // 루트에서 왼쪽 자식으로 계속 이동하여 가장 왼쪽 노드를 찾음
-  while (ptr->right != t->nil) {
-    ptr = ptr->right;
-  }
-  return ptr;  // 가장 왼쪽 노드가 최소값을 가짐
+  return t->max == t->nil ? NULL : t->max;
 }
 
 // node_t* tree_minimum(rbtree *t, node_t *z){ // successor 찾는중에 오른쪽노드가있을때 들어가서 제일 왼쪽노드 찾으려고 만든함수
@@ -315,6 +1012,18 @@ node_t *tree_minimum(const rbtree *t, node_t *sub_root){
 }
 
 
+static node_t *tree_maximum(const rbtree *t, node_t *sub_root){
+    node_t *r = sub_root;
+    if (r == t -> nil)
+        return r;
+    while (r -> right != t -> nil)
+    {
+        r = r -> right;
+    }
+    return r;
+}
+
+
 // node_t* tree_successor(rbtree *t ,node_t *z){
 //   if(z->right != t->nil){
 //     //오른쪽 서브트리가 존재하는경우
@@ -328,155 +1037,454 @@ node_t *tree_minimum(const rbtree *t, node_t *sub_root){
 //   return y; // 모든루프에서 나오면 y반환
 // }
 
-void rbtree_transplant(rbtree *t , node_t * u, node_t *v){
-  if(u->parent == t->nil){ // 변경하려는 위치의 노드가 루트노드일때
-    t->root =v;
+node_t *get_next_node(const rbtree *t, node_t *p){
+  //트리는 변경되지 말라고 const로 받아옴
+  node_t *current = p->right;
+  if(current == t->nil){ // 현재 오른쪽 자식이 없으면(현재보다 큰값이 없으면)
+    current = p;
+    while(1){ // 다음 인오더 노드를 찾는 방법
+      if(current->parent->right == current){ // 내가 오른쪽에서 온경우
+        current = current->parent; //부모노드로 이동후 탐색
+      }
+      else{
+        return current->parent; // current가 왼쪽에서 온경우 부모 리턴
+      }
+    }
   }
-  else if(u == u->parent->left){ // 내 부모가 상위노드기준 왼쪽에서 왔는지
-    u->parent->left = v;
+  // 오른쪽 자식이 있는 경우
+  while(current->left != t->nil){ // 왼쪽자식이 있는 경우
+    current = current->left; // 왼쪽 끝으로 이동
   }
-  else{ // 내 부모가 상위노드기준 오른쪽에서 왔는지
-    u->parent->right = v;
+  return current;
+}
+
+static node_t *get_prev_node(const rbtree *t, node_t *p){
+  // get_next_node와 대칭 (왼쪽 <-> 오른쪽)
+  node_t *current = p->left;
+  if(current == t->nil){
+    current = p;
+    while(current->parent->left == current){
+      current = current->parent;
+    }
+    return current->parent;
   }
-  v->parent = u->parent; // 새로 올리려는 노드의 부모주소를 이전에 있던 노드의 부모주소로 부모관계 정리
+  while(current->right != t->nil){
+    current = current->right;
+  }
+  return current;
 }
 
 
-void rb_delete_fixup(rbtree *t, node_t *x){
-    node_t *w;
-    while ((x != t -> root) && (x -> color == RBTREE_BLACK))
+// z가 지워지기 전에 index에서 z를 뺀다. index가 z를 가리키고 있으면 같은 key의 이웃 노드로 바꾸고
+// 이웃이 없으면 key를 제거 (같은 key들은 중위순회에서 연속해 있음)
+static void rbtree_index_unlink(rbtree *t, node_t *z){
+    rbtree_index_slot *slot = rbtree_index_probe(t, z->key);
+    if (slot == NULL || slot->node != z)
     {
-        if (x == x -> parent -> left)
-        {
-            w = x -> parent -> right;
-            if (w -> color == RBTREE_RED)
-            {
-                w -> color = RBTREE_BLACK;
-                x -> parent -> color = RBTREE_RED;
-                rbtree_left_rotate(t, x -> parent);
-                w = x -> parent -> right;
-            }
-            if (w -> left -> color == RBTREE_BLACK && w -> right -> color == RBTREE_BLACK)
-            {
-                w -> color = RBTREE_RED;
-                x = x -> parent;
-            }
-            else
-            {
-                if (w -> right -> color == RBTREE_BLACK)
-                {
-                    w -> left -> color = RBTREE_BLACK;
-                    w -> color = RBTREE_RED;
-                    rbtree_right_rotate(t, w);
-                    w = x -> parent -> right;
-                }
-                w -> color = x -> parent -> color;
-                x -> parent -> color = RBTREE_BLACK;
-                w -> right -> color = RBTREE_BLACK;
-                rbtree_left_rotate(t, x -> parent);
-                x = t->root;
-            }
-        }
-        else
-        {
-            w = x -> parent -> left;
-            if (w -> color == RBTREE_RED)
-            {
-                w -> color = RBTREE_BLACK;
-                x -> parent->color = RBTREE_RED;
-                rbtree_right_rotate(t, x -> parent);
-                w = x -> parent->left;
-            }
-            if (w -> right -> color == RBTREE_BLACK && w -> left -> color == RBTREE_BLACK)
-            {
-                w -> color = RBTREE_RED;
-                x = x -> parent;
-            }
-            else
-            {
-                if (w -> left -> color == RBTREE_BLACK)
-                {
-                    w -> right -> color = RBTREE_BLACK;
-                    w -> color = RBTREE_RED;
-                    rbtree_left_rotate(t, w);
-                    w = x -> parent -> left;
-                }
-                w -> color = x -> parent -> color;
-                x -> parent -> color = RBTREE_BLACK;
-                w -> left -> color = RBTREE_BLACK;
-                rbtree_right_rotate(t, x -> parent);
-                x = t -> root;
-            }
-        }
+      return;
+    }
+    node_t *q = get_prev_node(t, z);
+    if (q == t->nil || q->key != z->key)
+    {
+      q = get_next_node(t, z);
+    }
+    if (q != t->nil && q->key == z->key)
+    {
+      slot->node = q;
+    }
+    else
+    {
+      rbtree_index_remove(t, z->key);
     }
-    x -> color = RBTREE_BLACK;
 }
 
+// z를 트리에서 떼어내고 index, min/max 캐시, compaction cursor를 맞춘다. (메모리는 그대로)
+static void rbtree_unlink(rbtree *t, node_t *z){
+    if (t->mode & RBTREE_MODE_INDEXED)
+    {
+      rbtree_index_unlink(t, z);
+    }
+    // 최소/최대 노드가 지워지면 캐시를 바로 옆 노드로 옮김
+    if (z == t->min)
+    {
+        t->min = get_next_node(t, z);
+    }
+    if (z == t->max)
+    {
+        t->max = get_prev_node(t, z);
+    }
+
+    if (z == t->pool.cursor)   // compaction cursor는 다음 노드로 넘김
+    {
+      t->pool.cursor = get_next_node(t, z);
+    }
 
+    rbtree_detach(t, z);
+}
 
 int rbtree_erase(rbtree *t, node_t *z){
-    node_t *y = z;
-    color_t y_orginal_color = y->color;
-    node_t *x;
-    if (z -> left == t -> nil)
+    t->size--;
+    if (z->count > 1)          // counted mode: 개수만 줄이고 노드는 그대로 둠
     {
-        x = z -> right;
-        rbtree_transplant(t, z, z -> right);
+        z->count--;
+        rbtree_pull_path(t, z);
+        RBTREE_CHECK(t);
+        return 0;
     }
-    else if (z -> right == t -> nil)
+
+    rbtree_unlink(t, z);
+    rbtree_free_node(t, z);
+    RBTREE_CHECK(t);
+    return 0;
+}
+
+void rbtree_set_capacity(rbtree *t, const size_t capacity){
+    t->capacity = capacity;
+    if (capacity != 0 && t->size > capacity)  // 이미 넘쳐 있으면 작은 것부터 버림
     {
-        x = z -> left;
-        rbtree_transplant(t, z, z -> left);
+      rbtree_erase_min_n(t, t->size - capacity);
     }
-    else
+}
+
+// capacity가 찬 상태의 insert. 최소값 이하의 key는 캐시된 min과 한 번 비교해서 바로 거절하고,
+// 아니면 최소 노드를 떼어낸 뒤 그 메모리에 새 key를 넣어 다시 삽입한다. (malloc/free 없음)
+static node_t *rbtree_insert_evict(rbtree *t, const key_t key){
+    node_t *m = t->min;
+    if (key <= m->key)
     {
-        y = tree_minimum(t, z -> right);
-        y_orginal_color = y->color;
-        x = y -> right;
-        if (y -> parent == z)
-        {
-            x -> parent = y;
-        }
-        else
+      return NULL;
+    }
+    if (t->mode & RBTREE_MODE_COUNTED)
+    {
+      // 이미 있는 key면 개수만 올리고, 최소 key가 여러 개면 하나만 줄이면 되므로 노드를 재사용할 수 없음
+      node_t *p = rbtree_find(t, key);
+      if (p != NULL || m->count > 1)
+      {
+        rbtree_erase(t, m);
+        if (p != NULL)
         {
-            rbtree_transplant(t, y, y -> right);
-            y -> right = z -> right;
-            y -> right -> parent = y;
+          return rbtree_bump(t, p);
         }
-        rbtree_transplant(t, z, y);
-        y -> left = z -> left;
-        y -> left -> parent = y;
-        y -> color = z -> color;
+        node_t *z = rbtree_new_node(t, key);
+        rbtree_insert_at(t, rbtree_insert_parent(t, t->root, key), z);
+        return z;
+      }
+    }
+    rbtree_unlink(t, m);
+    t->size -= m->count;
+    m->key = key;
+    m->count = 1;
+    rbtree_insert_at(t, rbtree_insert_parent(t, t->root, key), m);
+    return m;
+}
+
+// 루트에서 왼쪽 끝까지의 BLACK 노드 개수 (nil 제외) = x subtree의 black height
+static int rbtree_black_height(const rbtree *t, node_t *x){
+  int h = 0;
+  while (x != t->nil)
+  {
+    h += (x->color == RBTREE_BLACK);
+    x = x->left;
+  }
+  return h;
+}
+
+// 독립된 RB tree l, r (l의 key <= k->key <= r의 key)을 노드 k로 이어 붙인 트리의 루트를 반환
+// hl, hr은 l, r의 black height (rbtree_black_height 기준)이고 결과 트리의 black height는 *h에 담는다.
+// black height가 낮은 쪽을 높은 쪽 가장자리에서 같은 높이의 BLACK 노드 자리에 붙이고
+// 삽입과 같은 fixup으로 red-red를 정리한다. 높이를 다시 세지 않으므로 O(|hl - hr| + 1)
+static node_t *rbtree_join(rbtree *t, node_t *l, int hl, node_t *k, node_t *r, int hr, int *h){
+  node_t *nil = t->nil;
+  if (l->color == RBTREE_RED)       // 독립된 트리이므로 루트를 BLACK으로 칠해도 됨 (높이 +1)
+  {
+    l->color = RBTREE_BLACK;
+    hl++;
+  }
+  if (r->color == RBTREE_RED)
+  {
+    r->color = RBTREE_BLACK;
+    hr++;
+  }
+
+  if (hl == hr)                     // 높이가 같으면 k를 새 루트로
+  {
+    k->left = l;
+    k->right = r;
+    k->parent = nil;
+    k->color = RBTREE_BLACK;
+    if (l != nil) l->parent = k;
+    if (r != nil) r->parent = k;
+    RBTREE_PULL(k);
+    *h = hl + 1;
+    return k;
+  }
+
+  rbtree sub = {.root = (hl > hr) ? l : r, .nil = nil};
+  sub.root->parent = nil;
+  int high = (hl > hr) ? hl : hr;
+  int target = (hl > hr) ? hr : hl;
+  int cur = high;
+  node_t *c = sub.root, *p = nil;
+  // 높은 트리의 안쪽 가장자리를 따라 내려가며 black height가 target인 BLACK 노드 c를 찾음
+  while (!(c->color == RBTREE_BLACK && cur == target))
+  {
+    cur -= (c->color == RBTREE_BLACK);
+    p = c;
+    c = (hl > hr) ? c->right : c->left;
+  }
+
+  k->parent = p;
+  k->color = RBTREE_RED;
+  if (hl > hr)                      // c 자리에 k를 넣고 c를 k의 왼쪽, r을 오른쪽으로
+  {
+    p->right = k;
+    k->left = c;
+    k->right = r;
+  }
+  else
+  {
+    p->left = k;
+    k->left = l;
+    k->right = c;
+  }
+  if (k->left != nil) k->left->parent = k;
+  if (k->right != nil) k->right->parent = k;
+  rbtree_pull_path(t, k);
+
+  *h = high + rbtree_insert_fixup(&sub, k);
+  return sub.root;
+}
+
+// 가운데 노드 없이 l, r을 이어 붙임 (r의 최소 노드를 떼어서 가운데로 사용)
+// 최소 노드를 뗀 뒤의 r 높이만 한 번 다시 센다. O(log n)
+static node_t *rbtree_join2(rbtree *t, node_t *l, int hl, node_t *r, int hr, int *h){
+  if (l == t->nil)
+  {
+    *h = hr;
+    return r;
+  }
+  if (r == t->nil)
+  {
+    *h = hl;
+    return l;
+  }
+  rbtree sub = {.root = r, .nil = t->nil};
+  r->parent = t->nil;
+  node_t *m = tree_minimum(t, r);
+  rbtree_detach(&sub, m);
+  return rbtree_join(t, l, hl, m, sub.root, rbtree_black_height(t, sub.root), h);
+}
+
+// black height가 hx인 x subtree를 key 기준으로 나눈다. *l에는 key보다 작은 (inclusive면 key 이하인)
+// 노드들, *r에는 나머지가 들어가고 각각의 black height는 *hl, *hr에 담긴다.
+// 자식의 높이는 hx에서 바로 구하고 경로 위 join들의 비용 |hl - hr|이 서로 상쇄되므로 전체 O(log n)
+static void rbtree_split(rbtree *t, node_t *x, const int hx, const key_t key, const int inclusive,
+                  node_t **l, int *hl, node_t **r, int *hr){
+  if (x == t->nil)
+  {
+    *l = *r = t->nil;
+    *hl = *hr = 0;
+    return;
+  }
+  node_t *xl = x->left, *xr = x->right;
+  const int hc = hx - (x->color == RBTREE_BLACK);  // 양쪽 자식의 black height
+  if (x->key > key || (!inclusive && x->key == key))  // x는 오른쪽으로
+  {
+    node_t *b;
+    int hb;
+    rbtree_split(t, xl, hc, key, inclusive, l, hl, &b, &hb);
+    *r = rbtree_join(t, b, hb, x, xr, hc, hr);
+  }
+  else
+  {
+    node_t *a;
+    int ha;
+    rbtree_split(t, xr, hc, key, inclusive, &a, &ha, r, hr);
+    *l = rbtree_join(t, xl, hc, x, a, ha, hl);
+  }
+}
+
+// key보다 큰 첫 노드 (없으면 nil)
+static node_t *rbtree_upper_bound(const rbtree *t, const key_t key){
+  node_t *x = t->root, *y = t->nil;
+  while (x != t->nil)
+  {
+    if (x->key > key)
+    {
+      y = x;
+      x = x->left;
     }
-    if (y_orginal_color == RBTREE_BLACK)
+    else
     {
-        rb_delete_fixup(t, x);
+      x = x->right;
     }
-    free(z);
+  }
+  return y;
+}
+
+size_t rbtree_erase_range(rbtree *t, const key_t lo, const key_t hi){
+  // [lo, hi] 구간을 split으로 통째로 떼어낸 뒤 나머지를 한 번만 join하고 떼어낸 노드들은 한꺼번에 free
+  if (lo > hi || t->root == t->nil || hi < t->min->key || lo > t->max->key)
+  {
     return 0;
+  }
+  // compaction cursor가 지워질 구간 안에 있으면 구간 바로 뒤의 노드로 옮김
+  const int cursor_in_range = t->pool.cursor != t->nil && t->pool.cursor->key >= lo && t->pool.cursor->key <= hi;
+  node_t *a, *b, *mid, *c;
+  int ha, hb, hmid, hc, h;
+  rbtree_split(t, t->root, rbtree_black_height(t, t->root), lo, 0, &a, &ha, &b, &hb);  // a: lo 미만
+  rbtree_split(t, b, hb, hi, 1, &mid, &hmid, &c, &hc);  // mid: [lo, hi], c: hi 초과
+  t->root = rbtree_join2(t, a, ha, c, hc, &h);
+  t->root->parent = t->nil;
+
+  size_t removed = freeNode(mid, t);
+  t->size -= removed;
+  t->min = tree_minimum(t, t->root);
+  t->max = tree_maximum(t, t->root);
+  if (cursor_in_range)
+  {
+    t->pool.cursor = rbtree_upper_bound(t, hi);
+  }
+  RBTREE_CHECK(t);
+  return removed;
 }
 
-node_t *get_next_node(const rbtree *t, node_t *p){
-  //트리는 변경되지 말라고 const로 받아옴
-  node_t *current = p->right;
-  if(current == t->nil){ // 현재 오른쪽 자식이 없으면(현재보다 큰값이 없으면)
-    current = p;
-    while(1){ // 다음 인오더 노드를 찾는 방법
-      if(current->parent->right == current){ // 내가 오른쪽에서 온경우
-        current = current->parent; //부모노드로 이동후 탐색
-      }
-      else{
-        return current->parent; // current가 왼쪽에서 온경우 부모 리턴
-      }
-    }
+size_t rbtree_erase_min_n(rbtree *t, const size_t k){
+  if (k == 0 || t->root == t->nil)
+  {
+    return 0;
   }
-  // 오른쪽 자식이 있는 경우
-  while(current->left != t->nil){ // 왼쪽자식이 있는 경우
-    current = current->left; // 왼쪽 끝으로 이동
+  if (k >= t->size)                 // 전부 지우는 경우
+  {
+    size_t removed = freeNode(t->root, t);
+    t->root = t->min = t->max = t->nil;
+    t->size = 0;
+    RBTREE_CHECK(t);
+    return removed;
   }
-  return current;
+
+  // k번째 key를 가진 노드 s를 찾고, s의 key보다 작은 key들은 한 번에 잘라냄
+  node_t *s = t->min;
+  size_t skipped = 0;
+  while (skipped + s->count <= k)
+  {
+    skipped += s->count;
+    s = get_next_node(t, s);
+  }
+  size_t removed = 0;
+  if (s->key > t->min->key)
+  {
+    removed = rbtree_erase_range(t, t->min->key, s->key - 1);
+  }
+  // 남은 것들은 s와 같은 key: counted mode면 s의 count만 한 번에 줄이고 (s는 남음),
+  // 아니면 최소값부터 하나씩 지움
+  if ((t->mode & RBTREE_MODE_COUNTED) && removed < k)
+  {
+    const size_t rest = k - removed;
+    t->min->count -= (unsigned int)rest;
+    t->size -= rest;
+    rbtree_pull_path(t, t->min);
+    removed = k;
+    RBTREE_CHECK(t);
+  }
+  while (removed < k)
+  {
+    rbtree_erase(t, t->min);
+    removed++;
+  }
+  return removed;
+}
+
+// x를 y로 옮기고 x를 가리키던 모든 pointer(부모, 자식, 루트, min/max, index)를 y로 바꾼다.
+static void rbtree_relocate(rbtree *t, node_t *x, node_t *y)
+{
+  *y = *x;
+  if (x->parent == t->nil)
+  {
+    t->root = y;
+  }
+  else if (x == x->parent->left)
+  {
+    x->parent->left = y;
+  }
+  else
+  {
+    x->parent->right = y;
+  }
+  if (x->left != t->nil)
+  {
+    x->left->parent = y;
+  }
+  if (x->right != t->nil)
+  {
+    x->right->parent = y;
+  }
+  if (t->min == x)
+  {
+    t->min = y;
+  }
+  if (t->max == x)
+  {
+    t->max = y;
+  }
+  if (t->mode & RBTREE_MODE_INDEXED)
+  {
+    rbtree_index_slot *slot = rbtree_index_probe(t, x->key);
+    if (slot != NULL && slot->node == x)
+    {
+      slot->node = y;
+    }
+  }
+  rbtree_free_node(t, x);
 }
 
+int rbtree_compact(rbtree *t, const size_t budget, rbtree_compact_stats *stats){
+  // 중위순회 순서대로 노드를 새 slab의 연속된 자리로 옮긴다. cursor가 다음에 옮길 노드를 기억하므로
+  // 연산 사이사이에 budget만큼씩 나눠서 불러도 되고, 옮겨진 뒤 비게 된 예전 slab은 바로 반환된다.
+  rbtree_pool *pool = &t->pool;
+  const size_t reclaimed = pool->reclaimed;
+  size_t moved = 0;
+
+  // budget이 0이면 아무것도 하지 않음: pass를 시작하거나 끝내지 않고 slab도 잡지 않음
+  if (!pool->compacting && budget > 0)  // 새 pass 시작
+  {
+    pool->compacting = 1;
+    pool->cursor = t->min;
+    pool->pass_moved = pool->pass_adjacent = 0;
+  }
+
+  while (moved < budget && pool->cursor != t->nil)
+  {
+    node_t *x = pool->cursor;
+    if (pool->pass_moved == 0)      // pass의 첫 노드를 옮길 때에야 새 slab을 잡고 거기부터 채움
+    {
+      rbtree_pool_grow(t);
+    }
+    node_t *y = rbtree_pool_alloc(t);
+    rbtree_relocate(t, x, y);
+    node_t *prev = get_prev_node(t, y);
+    pool->pass_adjacent += (prev != t->nil && prev + 1 == y);
+    pool->pass_moved++;
+    pool->cursor = get_next_node(t, y);
+    moved++;
+  }
+
+  const int done = budget > 0 && pool->cursor == t->nil;
+  if (done)
+  {
+    pool->compacting = 0;
+  }
+  if (stats != NULL)
+  {
+    stats->moved = moved;
+    stats->reclaimed = pool->reclaimed - reclaimed;
+    stats->pool_bytes = pool->bytes;
+    stats->locality = pool->pass_moved == 0 ? 1.0 : (double)pool->pass_adjacent / (double)pool->pass_moved;
+    stats->done = done;
+  }
+  RBTREE_CHECK(t);
+  return done;
+}
 
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
   // TODO: implement to_array
@@ -487,15 +1495,244 @@ int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
     return 0; // 배열 크기가 0인경우
   }
 
-  node_t *current = rbtree_min(t);
-  for(int i =0; i<n; i++){
-    
-    if(current == t->nil){
-      break;
+  node_t *current = t->min;
+  size_t i = 0;
+  while(i < n && current != t->nil){
+    // counted mode에서는 개수만큼 같은 key를 펼쳐서 넣음
+    for(size_t c = 0; c < current->count && i < n; c++){
+      arr[i++] = current->key;
     }
-    arr[i] = current->key;
     current = get_next_node(t, current);
   }
   return 0;
 }
 
+size_t rbtree_count(const rbtree *t, const key_t key) {
+  node_t *p = rbtree_find(t, key);
+  if (p == NULL)
+  {
+    return 0;
+  }
+  if (t->mode & RBTREE_MODE_COUNTED)
+  {
+    return p->count;
+  }
+  // 같은 key들은 중위순회에서 연속해 있으므로 찾은 노드의 양옆으로 센다
+  size_t cnt = 1;
+  for (node_t *q = get_prev_node(t, p); q != t->nil && q->key == key; q = get_prev_node(t, q))
+  {
+    cnt++;
+  }
+  for (node_t *q = get_next_node(t, p); q != t->nil && q->key == key; q = get_next_node(t, q))
+  {
+    cnt++;
+  }
+  return cnt;
+}
+
+size_t rbtree_size(const rbtree *t) {
+  return t->size;
+}
+
+
+rbtree_check_t rbtree_validate(const rbtree *t) {
+  // 재귀 없이 parent pointer를 따라 중위순회 하면서 모든 불변식을 O(n)에 확인한다.
+  // depth는 루트부터 현재 노드까지 (현재 노드 포함) BLACK 노드의 개수
+  node_t *nil = t->nil;
+  if (nil->color != RBTREE_BLACK)
+  {
+    return RBTREE_INVALID_RED;
+  }
+  if (t->root == nil)
+  {
+    if (t->size != 0)
+    {
+      return RBTREE_INVALID_COUNT;
+    }
+    if (t->index.used != 0)
+    {
+      return RBTREE_INVALID_INDEX;
+    }
+    if (t->pool.cursor != nil)
+    {
+      return RBTREE_INVALID_CURSOR;
+    }
+    return (t->min == nil && t->max == nil) ? RBTREE_VALID : RBTREE_INVALID_MINMAX;
+  }
+  if (t->root->color != RBTREE_BLACK || t->root->parent != nil)
+  {
+    return RBTREE_INVALID_ROOT;
+  }
+
+  node_t *x = t->root;
+  int state = 0;                    // x에 0: 위에서 내려옴, 1: 왼쪽에서 올라옴, 2: 오른쪽에서 올라옴
+  node_t *first = nil, *last = nil; // 중위순회에서 처음/마지막으로 방문한 노드
+  int depth = 1;
+  int black_height = -1;
+  size_t total = 0;
+  const int indexed = (t->mode & RBTREE_MODE_INDEXED) != 0;
+  size_t distinct = 0;              // 서로 다른 key의 개수 (index 크기와 같아야 함)
+  int index_hit = 0;                // 지금 보고 있는 같은 key 묶음 중에 index가 가리키는 노드가 있었는지
+  int cursor_seen = !t->pool.compacting || t->pool.cursor == nil;
+  size_t nodes = 0;                 // node 개수 (pool/heap 할당 개수와 같아야 함)
+
+  while (x != nil)
+  {
+    if (state == 0)
+    {
+      if (x->color == RBTREE_RED && x->parent->color == RBTREE_RED)
+      {
+        return RBTREE_INVALID_RED;
+      }
+      if ((x->left != nil && x->left->parent != x) || (x->right != nil && x->right->parent != x))
+      {
+        return RBTREE_INVALID_PARENT;
+      }
+      if (x->left != nil)
+      {
+        x = x->left;
+        depth += (x->color == RBTREE_BLACK);
+        continue;
+      }
+      if (black_height < 0)         // 처음 만난 NIL까지의 black height를 기준으로 삼음
+      {
+        black_height = depth;
+      }
+      else if (depth != black_height)
+      {
+        return RBTREE_INVALID_BLACK;
+      }
+    }
+
+    if (state != 2)                 // 왼쪽 subtree를 다 돌았으면 x를 방문
+    {
+      if (last != nil && (last->key > x->key ||
+                          ((t->mode & RBTREE_MODE_COUNTED) && last->key == x->key)))
+      {
+        return RBTREE_INVALID_ORDER;
+      }
+      if (x->count == 0 || (!(t->mode & RBTREE_MODE_COUNTED) && x->count != 1))
+      {
+        return RBTREE_INVALID_COUNT;
+      }
+      if (indexed)
+      {
+        if (last == nil || last->key != x->key)  // 새 key 묶음 시작
+        {
+          if (last != nil && !index_hit)
+          {
+            return RBTREE_INVALID_INDEX;
+          }
+          distinct++;
+          index_hit = 0;
+        }
+        index_hit |= (rbtree_find(t, x->key) == x);
+      }
+      if (first == nil)
+      {
+        first = x;
+      }
+      last = x;
+      total += x->count;
+      cursor_seen |= (x == t->pool.cursor);
+      nodes++;
+
+      if (x->right != nil)
+      {
+        x = x->right;
+        depth += (x->color == RBTREE_BLACK);
+        state = 0;
+        continue;
+      }
+      if (depth != black_height)
+      {
+        return RBTREE_INVALID_BLACK;
+      }
+    }
+
+    // 양쪽 subtree를 다 돌았으므로 부모로 올라감
+#ifdef RBTREE_AUGMENT
+    agg_t expected = RBTREE_AGG_COMBINE(RBTREE_AGG_COMBINE(x->left->agg, RBTREE_AGG_OF(x)), x->right->agg);
+    if (!RBTREE_AGG_EQ(x->agg, expected))
+    {
+      return RBTREE_INVALID_AGG;
+    }
+#endif
+    node_t *child = x;
+    depth -= (x->color == RBTREE_BLACK);
+    x = x->parent;
+    state = (child == x->left) ? 1 : 2;
+  }
+
+  size_t allocated = t->pool.heap_nodes;
+  for (size_t i = 0; i < t->pool.nslabs; i++)
+  {
+    allocated += t->pool.slabs[i]->live;
+  }
+  if (total != t->size || nodes != allocated)
+  {
+    return RBTREE_INVALID_COUNT;
+  }
+  if (indexed ? (!index_hit || distinct != t->index.used) : t->index.used != 0)
+  {
+    return RBTREE_INVALID_INDEX;
+  }
+  if (first != t->min || last != t->max)
+  {
+    return RBTREE_INVALID_MINMAX;
+  }
+  if (!cursor_seen)
+  {
+    return RBTREE_INVALID_CURSOR;
+  }
+  return RBTREE_VALID;
+}
+
+
+#ifdef RBTREE_AUGMENT
+agg_t rbtree_aggregate(const rbtree *t, const key_t lo, const key_t hi) {
+  // 구간 [lo, hi]가 갈라지는 노드 s까지 내려간 뒤, s의 왼쪽에서는 lo 경계를,
+  // 오른쪽에서는 hi 경계를 따라 내려가며 경계 안쪽 subtree의 aggregate를 통째로 더한다. O(log n)
+  // (monoid가 교환법칙을 만족하지 않아도 되도록 key 순서대로 합침)
+  node_t *nil = t->nil;
+  node_t *s = t->root;
+  while (s != nil && (s->key < lo || s->key > hi))
+  {
+    s = (s->key < lo) ? s->right : s->left;
+  }
+  if (s == nil)
+  {
+    return RBTREE_AGG_IDENTITY;
+  }
+
+  agg_t left = RBTREE_AGG_IDENTITY;   // s 왼쪽에서 lo 이상인 부분 (오른쪽부터 왼쪽으로 쌓음)
+  for (node_t *x = s->left; x != nil; )
+  {
+    if (x->key >= lo)
+    {
+      left = RBTREE_AGG_COMBINE(RBTREE_AGG_COMBINE(RBTREE_AGG_OF(x), x->right->agg), left);
+      x = x->left;
+    }
+    else
+    {
+      x = x->right;
+    }
+  }
+
+  agg_t right = RBTREE_AGG_IDENTITY;  // s 오른쪽에서 hi 이하인 부분 (왼쪽부터 오른쪽으로 쌓음)
+  for (node_t *x = s->right; x != nil; )
+  {
+    if (x->key <= hi)
+    {
+      right = RBTREE_AGG_COMBINE(right, RBTREE_AGG_COMBINE(x->left->agg, RBTREE_AGG_OF(x)));
+      x = x->right;
+    }
+    else
+    {
+      x = x->left;
+    }
+  }
+
+  return RBTREE_AGG_COMBINE(RBTREE_AGG_COMBINE(left, RBTREE_AGG_OF(s)), right);
+}
+#endif
@@ -7,26 +7,176 @@ typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
 typedef int key_t;
 
+// Range-aggregate augmentation (build everything with -DRBTREE_AUGMENT).
+// Each node keeps agg = combine(left->agg, RBTREE_AGG_OF(node), right->agg);
+// the default monoid is the sum of keys. Supply a different monoid through
+// -DRBTREE_AUGMENT_HEADER='"my_agg.h"' defining all of the macros below.
+#ifdef RBTREE_AUGMENT
+#ifdef RBTREE_AUGMENT_HEADER
+#include RBTREE_AUGMENT_HEADER
+#endif
+#ifndef RBTREE_AGG_T
+#define RBTREE_AGG_T long long
+#define RBTREE_AGG_IDENTITY 0
+#define RBTREE_AGG_OF(node) ((long long)(node)->key * (long long)(node)->count)
+#define RBTREE_AGG_COMBINE(a, b) ((a) + (b))
+#endif
+#ifndef RBTREE_AGG_EQ
+#define RBTREE_AGG_EQ(a, b) ((a) == (b))
+#endif
+typedef RBTREE_AGG_T agg_t;
+#endif
+
+// color and the multiplicity share one word, so counted mode costs no extra
+// space and a node stays 4 words in every mode.
+#define RBTREE_COUNT_MAX 0x7fffffffu
+
 typedef struct node_t {
-  color_t color;
+  unsigned int color : 1;   // color_t
+  unsigned int count : 31;  // multiplicity of key (always 1 unless RBTREE_MODE_COUNTED)
   key_t key;
   struct node_t *parent, *left, *right;
+#ifdef RBTREE_AUGMENT
+  agg_t agg;  // aggregate over this subtree
+#endif
 } node_t;
 
+// mode flags for new_rbtree_mode()
+#define RBTREE_MODE_COUNTED 0x1  // one node per distinct key, duplicates bump count
+#define RBTREE_MODE_INDEXED 0x2  // companion hash index, exact-match rbtree_find in O(1)
+#define RBTREE_MODE_ARENA 0x4     // nodes come from slabs instead of one malloc each
+#define RBTREE_MODE_HUGEPAGE 0x8  // arena slabs are 2MB huge pages (MAP_HUGETLB, else THP, else malloc)
+
+// NUMA placement of arena slabs, see rbtree_set_numa(); values are Linux's MPOL_*
+typedef enum {
+  RBTREE_NUMA_DEFAULT = 0,
+  RBTREE_NUMA_PREFERRED = 1,
+  RBTREE_NUMA_BIND = 2,
+  RBTREE_NUMA_INTERLEAVE = 3,
+  RBTREE_NUMA_LOCAL = 4
+} rbtree_numa_t;
+
+// open-addressing (linear probing) key -> node map kept by RBTREE_MODE_INDEXED.
+// Holds one node per distinct key; ordered operations still use the tree.
+typedef struct {
+  key_t key;
+  node_t *node;  // NULL if the slot is empty
+} rbtree_index_slot;
+
+typedef struct {
+  rbtree_index_slot *slots;
+  size_t cap;          // power of two, 0 until the first insert
+  size_t used;         // number of distinct keys
+  unsigned int shift;  // 64 - log2(cap), for Fibonacci hashing
+} rbtree_index;
+
+// Slab pool that rbtree_compact() relocates nodes into and RBTREE_MODE_ARENA
+// allocates from. Slabs are freed as soon as their last node is erased or
+// moved out again.
+struct rbtree_slab;
+
+typedef struct {
+  struct rbtree_slab **slabs;  // sorted by address, to tell pool nodes from malloc'd ones
+  size_t nslabs, cap;
+  struct rbtree_slab *active;  // slab being filled
+  struct rbtree_slab *partial; // slabs with erased nodes to reuse
+  size_t slab_nodes;           // nodes per slab (set by the first slab)
+  size_t heap_nodes;           // live nodes malloc'd one by one
+  rbtree_numa_t numa_policy;
+  unsigned long numa_nodes;    // node mask for BIND/INTERLEAVE/PREFERRED
+  size_t bytes;                // bytes held by slabs
+  size_t reclaimed;            // bytes handed back so far (freed nodes and empty slabs)
+  node_t *cursor;              // next node to move, in key order (nil when idle)
+  int compacting;              // a pass is in progress
+  size_t pass_moved, pass_adjacent;
+} rbtree_pool;
+
+typedef struct {
+  size_t moved;       // nodes relocated by this call
+  size_t reclaimed;   // bytes handed back during this call
+  size_t pool_bytes;  // bytes now held by compaction slabs
+  double locality;    // share of nodes moved this pass whose in-order predecessor sits right before them in memory
+  int done;           // this call finished the pass
+} rbtree_compact_stats;
+
+// rbtree_memory_usage(): where the bytes of a tree go
+typedef struct {
+  size_t nodes;          // live nodes
+  size_t overhead;       // tree header, sentinel, hash index, slab headers and table
+  size_t fragmentation;  // slab bytes not holding a live node (erased holes, unused tail)
+  size_t slab_bytes;     // everything allocated or mapped for slabs
+  size_t huge_bytes;     // part of slab_bytes on huge pages (MAP_HUGETLB or THP advised)
+  size_t unplaced_bytes; // part of slab_bytes the NUMA policy could not be applied to
+  size_t slabs;
+} rbtree_memory;
+
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  node_t *min, *max;  // cached leftmost/rightmost node (nil if empty)
+  unsigned int mode;
+  size_t size;  // number of keys including duplicates
+  rbtree_index index;  // empty unless RBTREE_MODE_INDEXED
+  rbtree_pool pool;
+  size_t capacity;  // top-K bound on size (0 = unbounded), see rbtree_set_capacity()
 } rbtree;
 
+// results of rbtree_validate()
+typedef enum {
+  RBTREE_VALID = 0,
+  RBTREE_INVALID_ROOT,    // root is red or has a parent
+  RBTREE_INVALID_PARENT,  // child->parent does not point back
+  RBTREE_INVALID_ORDER,   // keys are not sorted in-order
+  RBTREE_INVALID_RED,     // red node with a red parent
+  RBTREE_INVALID_BLACK,   // paths with different black heights
+  RBTREE_INVALID_COUNT,   // bad multiplicity or cached size
+  RBTREE_INVALID_MINMAX,  // cached min/max out of date
+  RBTREE_INVALID_AGG,     // stale subtree aggregate (RBTREE_AUGMENT)
+  RBTREE_INVALID_INDEX,   // hash index disagrees with the tree (RBTREE_MODE_INDEXED)
+  RBTREE_INVALID_CURSOR   // compaction cursor is not a node of the tree
+} rbtree_check_t;
+
 rbtree *new_rbtree(void);
+rbtree *new_rbtree_mode(const unsigned int);
 void delete_rbtree(rbtree *);
 
 node_t *rbtree_insert(rbtree *, const key_t);
+node_t *rbtree_insert_hint(rbtree *, node_t *, const key_t);
 node_t *rbtree_find(const rbtree *, const key_t);
+node_t *rbtree_find_from(const rbtree *, node_t *, const key_t);
+size_t rbtree_find_many(const rbtree *, const key_t *, const size_t, node_t **);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
+size_t rbtree_erase_range(rbtree *, const key_t, const key_t);
+size_t rbtree_erase_min_n(rbtree *, const size_t);
+// keep at most capacity keys, the largest ones: once full, rbtree_insert
+// returns NULL for a key <= the minimum and otherwise evicts the minimum,
+// reusing its node. Shrinking below the current size drops the smallest keys.
+void rbtree_set_capacity(rbtree *, const size_t);
+size_t rbtree_count(const rbtree *, const key_t);
+size_t rbtree_size(const rbtree *);
+size_t rbtree_index_memory(const rbtree *);
+void rbtree_memory_usage(const rbtree *, rbtree_memory *);
+// place arena slabs on NUMA nodes (mask of node ids) for new slabs and, where
+// the kernel allows, migrate existing ones. -1 with the old policy kept if the
+// kernel rejects the policy or mask; -1 with the new policy in force if some
+// existing slab could not be moved (see rbtree_memory.unplaced_bytes)
+int rbtree_set_numa(rbtree *, const rbtree_numa_t, const unsigned long);
 
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
 
+// move up to budget nodes, in key order, into freshly packed slabs; returns 1
+// once the pass is complete. Moved nodes get new addresses, so node pointers
+// held from before the call must be looked up again. stats may be NULL.
+// A pass maps its first slab only when it moves its first node; budget 0 is
+// a no-op that returns 0.
+int rbtree_compact(rbtree *, const size_t budget, rbtree_compact_stats *);
+
+rbtree_check_t rbtree_validate(const rbtree *);
+
+#ifdef RBTREE_AUGMENT
+agg_t rbtree_aggregate(const rbtree *, const key_t, const key_t);
+#endif
+
 #endif  // _RBTREE_H_
@@ -0,0 +1,180 @@
+#include "rbtree_combine.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// lock을 잡은 combiner가 새로 게시된 작업을 찾아 다시 도는 최대 횟수
+#define RBTREE_COMBINE_PASSES 3
+// 기다리는 쓰레드가 이만큼 spin할 때마다 CPU를 양보 (쓰레드가 core보다 많을 때 combiner가 돌 수 있게)
+#define RBTREE_COMBINE_SPINS 64
+
+// combiner가 한 번에 처리할 작업 하나
+typedef struct {
+  key_t key;
+  rbtree_op_t op;
+  int slot;
+} combine_op;
+
+rbtree_combiner *new_rbtree_combiner(rbtree *t, const int max_threads)
+{
+  rbtree_combiner *c = (rbtree_combiner *)calloc(1, sizeof(rbtree_combiner));
+  // slot마다 cache line 하나씩 쓰도록 64 byte 정렬 (false sharing 방지)
+  rbtree_slot *slots = (rbtree_slot *)aligned_alloc(_Alignof(rbtree_slot), sizeof(rbtree_slot) * max_threads);
+  if (c == NULL || slots == NULL)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(slots, 0, sizeof(rbtree_slot) * max_threads);
+  c->t = t;
+  c->slots = slots;
+  c->max_threads = max_threads;
+  atomic_init(&c->lock, 0);
+  return c;
+}
+
+void delete_rbtree_combiner(rbtree_combiner *c)
+{
+  // tree는 caller 소유이므로 지우지 않음
+  free(c->slots);
+  free(c);
+}
+
+int rbtree_combiner_join(rbtree_combiner *c)
+{
+  int slot = atomic_fetch_add(&c->threads, 1);
+  if (slot >= c->max_threads)
+  {
+    fprintf(stderr, "rbtree_combiner: more than %d threads\n", c->max_threads);
+    exit(EXIT_FAILURE);
+  }
+  return slot;
+}
+
+static int combine_cmp(const void *p1, const void *p2)
+{
+  const combine_op *a = (const combine_op *)p1, *b = (const combine_op *)p2;
+  if (a->key != b->key)
+  {
+    return a->key < b->key ? -1 : 1;
+  }
+  return (int)a->op - (int)b->op;
+}
+
+// spin loop 안에서 CPU에 busy-wait 중임을 알림 (hyper-thread 양보, 전력 절약)
+static inline void rbtree_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// lock을 잡은 쓰레드가 게시된 작업을 모두 모아 key 순으로 적용하고 처리한 개수를 반환
+static int rbtree_combine_batch(rbtree_combiner *c, combine_op *batch)
+{
+  const int threads = atomic_load(&c->threads);
+  int n = 0;
+  for (int i = 0; i < threads; i++)
+  {
+    if (atomic_load_explicit(&c->slots[i].pending, memory_order_acquire))
+    {
+      batch[n].key = c->slots[i].key;
+      batch[n].op = c->slots[i].op;
+      batch[n].slot = i;
+      n++;
+    }
+  }
+  if (n == 0)                       // 이전 pass 이후 새로 게시된 작업이 없음
+  {
+    return 0;
+  }
+  qsort(batch, n, sizeof(combine_op), combine_cmp);
+
+  // 정렬되어 있으므로 직전 결과 node를 hint/finger로 쓰면 대부분 짧은 이동으로 끝남
+  node_t *last = NULL;
+  for (int i = 0; i < n; i++)
+  {
+    rbtree_slot *s = &c->slots[batch[i].slot];
+    node_t *p;
+    switch (batch[i].op)
+    {
+    case RBTREE_OP_INSERT:
+      p = rbtree_insert_hint(c->t, last, batch[i].key);
+      last = p;
+      break;
+    case RBTREE_OP_FIND:
+      p = rbtree_find_from(c->t, last, batch[i].key);
+      last = p != NULL ? p : last;
+      break;
+    case RBTREE_OP_ERASE:
+    default:
+      p = rbtree_find_from(c->t, last, batch[i].key);
+      if (p != NULL)
+      {
+        rbtree_erase(c->t, p);
+        last = NULL;                // 지운 node를 hint로 쓰면 안 됨
+      }
+      break;
+    }
+    s->result = p;
+    atomic_store_explicit(&s->pending, 0, memory_order_release);
+  }
+  c->batches++;
+  c->ops += n;
+  return n;
+}
+
+static node_t *rbtree_combine(rbtree_combiner *c, const int slot, const rbtree_op_t op, const key_t key)
+{
+  rbtree_slot *s = &c->slots[slot];
+  s->op = op;
+  s->key = key;
+  atomic_store_explicit(&s->pending, 1, memory_order_release);
+
+  combine_op batch[c->max_threads];
+  unsigned int spins = 0;
+  while (atomic_load_explicit(&s->pending, memory_order_acquire))
+  {
+    // test-and-test-and-set: lock이 비어 보일 때만 exchange로 cache line을 가져옴
+    if (atomic_load_explicit(&c->lock, memory_order_relaxed) == 0 &&
+        atomic_exchange_explicit(&c->lock, 1, memory_order_acquire) == 0)
+    {
+      // 첫 pass에서 내 작업이 처리되고, 그 사이 새로 게시된 작업이 있으면 몇 번 더 돈다
+      for (int pass = 0; pass < RBTREE_COMBINE_PASSES; pass++)
+      {
+        if (rbtree_combine_batch(c, batch) == 0)
+        {
+          break;
+        }
+      }
+      atomic_store_explicit(&c->lock, 0, memory_order_release);
+    }
+    else if (++spins % RBTREE_COMBINE_SPINS == 0)
+    {
+      sched_yield();
+    }
+    else
+    {
+      rbtree_cpu_relax();
+    }
+  }
+  return s->result;
+}
+
+node_t *rbtree_combine_insert(rbtree_combiner *c, const int slot, const key_t key)
+{
+  return rbtree_combine(c, slot, RBTREE_OP_INSERT, key);
+}
+
+node_t *rbtree_combine_find(rbtree_combiner *c, const int slot, const key_t key)
+{
+  return rbtree_combine(c, slot, RBTREE_OP_FIND, key);
+}
+
+int rbtree_combine_erase(rbtree_combiner *c, const int slot, const key_t key)
+{
+  return rbtree_combine(c, slot, RBTREE_OP_ERASE, key) != NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef _RBTREE_COMBINE_H_
+#define _RBTREE_COMBINE_H_
+
+#include <stdatomic.h>
+
+#include "rbtree.h"
+
+// Flat-combining front-end for many threads writing one rbtree.
+// Each thread publishes its operation in its own cache-line sized slot; the
+// thread that wins the lock becomes the combiner, collects every pending
+// slot, sorts the batch by key and applies it with the finger/hint calls
+// (so a batch costs one descent plus short walks), then hands the results
+// back, making a few passes while new requests keep arriving. Waiting
+// threads spin with plain loads on their own slot and only try the
+// test-and-test-and-set lock after a load has seen it free.
+// The single-threaded rbtree API is unchanged; do not call it on t directly
+// while other threads go through the combiner.
+
+typedef enum { RBTREE_OP_INSERT, RBTREE_OP_FIND, RBTREE_OP_ERASE } rbtree_op_t;
+
+typedef struct {
+  _Alignas(64) atomic_int pending;  // 1 while published, combiner stores 0 when done
+  rbtree_op_t op;
+  key_t key;
+  node_t *result;
+} rbtree_slot;
+
+typedef struct {
+  rbtree *t;
+  atomic_int lock;  // 1 while some thread is combining
+  rbtree_slot *slots;
+  int max_threads;
+  atomic_int threads;  // slots handed out by rbtree_combiner_join()
+  size_t batches, ops;  // statistics, updated by the combiner only
+} rbtree_combiner;
+
+rbtree_combiner *new_rbtree_combiner(rbtree *, const int max_threads);
+void delete_rbtree_combiner(rbtree_combiner *);
+
+// slot id for the calling thread, once per thread
+int rbtree_combiner_join(rbtree_combiner *);
+
+node_t *rbtree_combine_insert(rbtree_combiner *, const int slot, const key_t);
+// a found node stays valid only until some thread erases that key
+node_t *rbtree_combine_find(rbtree_combiner *, const int slot, const key_t);
+// erase one occurrence of key, 1 if there was one
+int rbtree_combine_erase(rbtree_combiner *, const int slot, const key_t);
+
+#endif  // _RBTREE_COMBINE_H_
@@ -0,0 +1,218 @@
+#ifndef _RBTREE_CORE_H_
+#define _RBTREE_CORE_H_
+
+#include "rbtree.h"
+
+// Internal: the CLRS rotations, transplant, insert fixup and delete fixup,
+// written once and instantiated for every linked red-black tree in src/
+// (node_t with a sentinel in rbtree.c, the NULL-leaf rb_link in
+// rbtree_link.c). Not part of the public API.
+//
+//   name          prefix of the generated static functions
+//   tree_t        tree handle passed to every function
+//   node_t        node type with parent/left/right/color fields
+//   LEAF(t)       the leaf value: t->nil, or NULL
+//   ROOT(t)       lvalue holding the root pointer
+//   PULL(t, x)    recompute x's augmented data from its children
+//   PULL_PATH(t, x)  PULL from x up to the root (x may be a leaf)
+//
+// Generated:
+//   name_left_rotate(t, x), name_right_rotate(t, x)
+//   name_transplant(t, u, v)        put v where u hangs
+//   int name_insert_fixup(t, z)     z linked in red; 1 if the black height grew
+//   name_erase_fixup(t, x, parent)  x (possibly a leaf) is short one black
+//   name_detach(t, z)               unlink z and rebalance, nothing freed
+#define RB_CORE_DEFINE(name, tree_t, node_t, LEAF, ROOT, PULL, PULL_PATH)     \
+  static int name##_is_red(tree_t *t, const node_t *x) {                      \
+    (void)t;                                                                  \
+    return x != LEAF(t) && x->color == RBTREE_RED;                            \
+  }                                                                           \
+                                                                              \
+  static void name##_replace_child(tree_t *t, node_t *u, node_t *v) {         \
+    if (u->parent == LEAF(t)) {                                               \
+      ROOT(t) = v;                                                            \
+    } else if (u == u->parent->left) {                                        \
+      u->parent->left = v;                                                    \
+    } else {                                                                  \
+      u->parent->right = v;                                                   \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static void name##_left_rotate(tree_t *t, node_t *x) {                      \
+    node_t *y = x->right;                                                     \
+    x->right = y->left;                                                       \
+    if (y->left != LEAF(t)) {                                                 \
+      y->left->parent = x;                                                    \
+    }                                                                         \
+    y->parent = x->parent;                                                    \
+    name##_replace_child(t, x, y);                                            \
+    y->left = x;                                                              \
+    x->parent = y;                                                            \
+    PULL(t, x); /* x is now below y */                                        \
+    PULL(t, y);                                                               \
+  }                                                                           \
+                                                                              \
+  static void name##_right_rotate(tree_t *t, node_t *x) {                     \
+    node_t *y = x->left;                                                      \
+    x->left = y->right;                                                       \
+    if (y->right != LEAF(t)) {                                                \
+      y->right->parent = x;                                                   \
+    }                                                                         \
+    y->parent = x->parent;                                                    \
+    name##_replace_child(t, x, y);                                            \
+    y->right = x;                                                             \
+    x->parent = y;                                                            \
+    PULL(t, x);                                                               \
+    PULL(t, y);                                                               \
+  }                                                                           \
+                                                                              \
+  static void name##_transplant(tree_t *t, node_t *u, node_t *v) {            \
+    name##_replace_child(t, u, v);                                            \
+    if (v != LEAF(t)) {                                                       \
+      v->parent = u->parent;                                                  \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static int name##_insert_fixup(tree_t *t, node_t *z) {                      \
+    /* a red parent is never the root, so the grandparent exists */          \
+    while (name##_is_red(t, z->parent)) {                                     \
+      node_t *g = z->parent->parent;                                          \
+      if (z->parent == g->left) {                                             \
+        node_t *y = g->right;                                                 \
+        if (name##_is_red(t, y)) { /* case 1: red uncle, recolor */           \
+          z->parent->color = RBTREE_BLACK;                                    \
+          y->color = RBTREE_BLACK;                                            \
+          g->color = RBTREE_RED;                                              \
+          z = g;                                                              \
+        } else {                                                              \
+          if (z == z->parent->right) { /* case 2 -> case 3 */                 \
+            z = z->parent;                                                    \
+            name##_left_rotate(t, z);                                         \
+          }                                                                   \
+          z->parent->color = RBTREE_BLACK; /* case 3 */                       \
+          z->parent->parent->color = RBTREE_RED;                              \
+          name##_right_rotate(t, z->parent->parent);                          \
+        }                                                                     \
+      } else { /* mirror image */                                             \
+        node_t *y = g->left;                                                  \
+        if (name##_is_red(t, y)) {                                            \
+          z->parent->color = RBTREE_BLACK;                                    \
+          y->color = RBTREE_BLACK;                                            \
+          g->color = RBTREE_RED;                                              \
+          z = g;                                                              \
+        } else {                                                              \
+          if (z == z->parent->left) {                                         \
+            z = z->parent;                                                    \
+            name##_right_rotate(t, z);                                        \
+          }                                                                   \
+          z->parent->color = RBTREE_BLACK;                                    \
+          z->parent->parent->color = RBTREE_RED;                              \
+          name##_left_rotate(t, z->parent->parent);                           \
+        }                                                                     \
+      }                                                                       \
+    }                                                                         \
+    const int grew = ROOT(t)->color == RBTREE_RED;                            \
+    ROOT(t)->color = RBTREE_BLACK;                                            \
+    return grew;                                                              \
+  }                                                                           \
+                                                                              \
+  /* parent is carried separately because x may be a leaf */                  \
+  static void name##_erase_fixup(tree_t *t, node_t *x, node_t *parent) {      \
+    node_t *w;                                                                \
+    while (x != ROOT(t) && !name##_is_red(t, x)) {                            \
+      if (x == parent->left) {                                                \
+        w = parent->right;                                                    \
+        if (name##_is_red(t, w)) {                                            \
+          w->color = RBTREE_BLACK;                                            \
+          parent->color = RBTREE_RED;                                         \
+          name##_left_rotate(t, parent);                                      \
+          w = parent->right;                                                  \
+        }                                                                     \
+        if (!name##_is_red(t, w->left) && !name##_is_red(t, w->right)) {      \
+          w->color = RBTREE_RED;                                              \
+          x = parent;                                                         \
+          parent = x->parent;                                                 \
+        } else {                                                              \
+          if (!name##_is_red(t, w->right)) {                                  \
+            w->left->color = RBTREE_BLACK;                                    \
+            w->color = RBTREE_RED;                                            \
+            name##_right_rotate(t, w);                                        \
+            w = parent->right;                                                \
+          }                                                                   \
+          w->color = parent->color;                                           \
+          parent->color = RBTREE_BLACK;                                       \
+          w->right->color = RBTREE_BLACK;                                     \
+          name##_left_rotate(t, parent);                                      \
+          x = ROOT(t);                                                        \
+        }                                                                     \
+      } else {                                                                \
+        w = parent->left;                                                     \
+        if (name##_is_red(t, w)) {                                            \
+          w->color = RBTREE_BLACK;                                            \
+          parent->color = RBTREE_RED;                                         \
+          name##_right_rotate(t, parent);                                     \
+          w = parent->left;                                                   \
+        }                                                                     \
+        if (!name##_is_red(t, w->right) && !name##_is_red(t, w->left)) {      \
+          w->color = RBTREE_RED;                                              \
+          x = parent;                                                         \
+          parent = x->parent;                                                 \
+        } else {                                                              \
+          if (!name##_is_red(t, w->left)) {                                   \
+            w->right->color = RBTREE_BLACK;                                   \
+            w->color = RBTREE_RED;                                            \
+            name##_left_rotate(t, w);                                         \
+            w = parent->left;                                                 \
+          }                                                                   \
+          w->color = parent->color;                                           \
+          parent->color = RBTREE_BLACK;                                       \
+          w->left->color = RBTREE_BLACK;                                      \
+          name##_right_rotate(t, parent);                                     \
+          x = ROOT(t);                                                        \
+        }                                                                     \
+      }                                                                       \
+    }                                                                         \
+    if (x != LEAF(t)) {                                                       \
+      x->color = RBTREE_BLACK;                                                \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static void name##_detach(tree_t *t, node_t *z) {                           \
+    node_t *y = z, *x, *x_parent;                                             \
+    color_t y_original_color = y->color;                                      \
+    if (z->left == LEAF(t)) {                                                 \
+      x = z->right;                                                           \
+      x_parent = z->parent;                                                   \
+      name##_transplant(t, z, z->right);                                      \
+    } else if (z->right == LEAF(t)) {                                         \
+      x = z->left;                                                            \
+      x_parent = z->parent;                                                   \
+      name##_transplant(t, z, z->left);                                       \
+    } else {                                                                  \
+      y = z->right; /* successor: minimum of the right subtree */             \
+      while (y->left != LEAF(t)) {                                            \
+        y = y->left;                                                          \
+      }                                                                       \
+      y_original_color = y->color;                                            \
+      x = y->right;                                                           \
+      if (y->parent == z) {                                                   \
+        x_parent = y;                                                         \
+      } else {                                                                \
+        x_parent = y->parent;                                                 \
+        name##_transplant(t, y, y->right);                                    \
+        y->right = z->right;                                                  \
+        y->right->parent = y;                                                 \
+      }                                                                       \
+      name##_transplant(t, z, y);                                             \
+      y->left = z->left;                                                      \
+      y->left->parent = y;                                                    \
+      y->color = z->color;                                                    \
+    }                                                                         \
+    /* the lowest node whose subtree changed, up to the root */               \
+    PULL_PATH(t, x_parent);                                                   \
+    if (y_original_color == RBTREE_BLACK) {                                   \
+      name##_erase_fixup(t, x, x_parent);                                     \
+    }                                                                         \
+  }
+
+#endif  // _RBTREE_CORE_H_
@@ -0,0 +1,151 @@
+#include "rbtree_interval.h"
+
+#define interval_of(l) rb_entry(l, rb_interval, link)
+
+// 자식들의 max_hi와 자기 hi 중 최대값으로 max_hi 갱신 (회전/삽입/삭제 경로에서 호출됨)
+static void interval_augment(rb_link *l)
+{
+  rb_interval *n = interval_of(l);
+  key_t m = n->hi;
+  if (l->left != NULL && interval_of(l->left)->max_hi > m)
+  {
+    m = interval_of(l->left)->max_hi;
+  }
+  if (l->right != NULL && interval_of(l->right)->max_hi > m)
+  {
+    m = interval_of(l->right)->max_hi;
+  }
+  n->max_hi = m;
+}
+
+void rbtree_interval_insert(rb_root *root, rb_interval *node)
+{
+  rb_link **link = &root->root, *parent = NULL;
+  while (*link != NULL)             // lo 기준으로 내려감 (같으면 오른쪽, rbtree_insert와 같음)
+  {
+    parent = *link;
+    link = (node->lo < interval_of(parent)->lo) ? &parent->left : &parent->right;
+  }
+  node->max_hi = node->hi;
+  rb_link_node(&node->link, parent, link);
+  rb_insert_augmented(root, &node->link, interval_augment);
+}
+
+void rbtree_interval_erase(rb_root *root, rb_interval *node)
+{
+  rb_erase_augmented(root, &node->link, interval_augment);
+}
+
+// l subtree에서 [lo, hi]와 겹치는 가장 왼쪽 interval
+// 왼쪽 subtree의 max_hi가 lo 이상이면 왼쪽에 hi >= lo인 것이 있고, 그중 가장 왼쪽 것이
+// hi 조건까지 만족하지 못하면 그보다 오른쪽은 lo가 더 크므로 볼 필요가 없다.
+static rb_interval *interval_subtree_first(rb_link *l, const key_t lo, const key_t hi)
+{
+  while (1)
+  {
+    if (l->left != NULL && interval_of(l->left)->max_hi >= lo)
+    {
+      l = l->left;
+      continue;
+    }
+    rb_interval *n = interval_of(l);
+    if (n->lo > hi)                 // 여기부터 오른쪽은 모두 hi보다 뒤에서 시작
+    {
+      return NULL;
+    }
+    if (n->hi >= lo)
+    {
+      return n;
+    }
+    if (l->right == NULL || interval_of(l->right)->max_hi < lo)
+    {
+      return NULL;
+    }
+    l = l->right;
+  }
+}
+
+rb_interval *rbtree_interval_overlap(const rb_root *root, const key_t lo, const key_t hi)
+{
+  if (root->root == NULL || lo > hi || interval_of(root->root)->max_hi < lo)
+  {
+    return NULL;
+  }
+  return interval_subtree_first(root->root, lo, hi);
+}
+
+rb_interval *rbtree_interval_next(const rb_interval *node, const key_t lo, const key_t hi)
+{
+  // node 왼쪽은 이미 다 봤으므로 오른쪽 subtree, 그다음 왼쪽에서 올라온 조상 순으로 본다
+  const rb_link *l = &node->link;
+  rb_link *right = l->right;
+  while (1)
+  {
+    if (right != NULL && interval_of(right)->max_hi >= lo)
+    {
+      return interval_subtree_first(right, lo, hi);
+    }
+    const rb_link *prev;
+    do                              // 왼쪽 자식에서 올라오는 조상까지 올라감
+    {
+      prev = l;
+      l = l->parent;
+      if (l == NULL)
+      {
+        return NULL;
+      }
+    } while (prev == l->right);
+
+    rb_interval *n = interval_of(l);
+    if (n->lo > hi)
+    {
+      return NULL;
+    }
+    if (n->hi >= lo)
+    {
+      return n;
+    }
+    right = l->right;
+  }
+}
+
+// max_hi >= lo인 subtree l을 in-order로 돌면서 겹치는 interval을 바로 기록
+// 왼쪽은 재귀, 오른쪽은 반복문으로 내려가므로 재귀 깊이는 트리 높이 이하.
+// max_hi < lo인 subtree와 lo > hi인 node의 오른쪽은 통째로 건너뛰므로 들어가는 subtree에는
+// (경계 경로 위의 것을 빼면) 결과가 하나 이상 있다.
+static void interval_stab_subtree(const rb_link *l, const key_t lo, const key_t hi,
+                                  rb_interval **out, const size_t n, size_t *found)
+{
+  while (l != NULL && interval_of(l)->max_hi >= lo)
+  {
+    if (l->left != NULL && interval_of(l->left)->max_hi >= lo)
+    {
+      interval_stab_subtree(l->left, lo, hi, out, n, found);
+    }
+    rb_interval *x = interval_of(l);
+    if (x->lo > hi)                 // 여기부터 오른쪽은 모두 hi보다 뒤에서 시작
+    {
+      return;
+    }
+    if (x->hi >= lo)
+    {
+      if (*found < n)
+      {
+        out[*found] = x;
+      }
+      (*found)++;
+    }
+    l = l->right;
+  }
+}
+
+size_t rbtree_interval_stab(const rb_root *root, const key_t lo, const key_t hi,
+                            rb_interval **out, const size_t n)
+{
+  size_t found = 0;
+  if (lo <= hi)
+  {
+    interval_stab_subtree(root->root, lo, hi, out, n, &found);
+  }
+  return found;
+}
@@ -0,0 +1,35 @@
+#ifndef _RBTREE_INTERVAL_H_
+#define _RBTREE_INTERVAL_H_
+
+#include "rbtree_link.h"
+
+// Interval tree on top of the intrusive red-black core (rbtree_link.h).
+// Intervals are closed [lo, hi], ordered by lo, and every node keeps the
+// largest hi of its subtree (max_hi), maintained through the rotations and
+// fixups of rb_insert_augmented/rb_erase_augmented. Embed an rb_interval in
+// your own struct and get back to it with rb_entry().
+
+typedef struct rb_interval {
+  rb_link link;
+  key_t lo, hi;
+  key_t max_hi;  // max hi over this subtree
+} rb_interval;
+
+void rbtree_interval_insert(rb_root *, rb_interval *);
+void rbtree_interval_erase(rb_root *, rb_interval *);
+
+// first interval (in lo order) overlapping [lo, hi], or NULL;
+// a point stabbing query is rbtree_interval_overlap(root, x, x)
+rb_interval *rbtree_interval_overlap(const rb_root *, const key_t lo, const key_t hi);
+// next interval after it that overlaps [lo, hi], or NULL
+rb_interval *rbtree_interval_next(const rb_interval *, const key_t lo, const key_t hi);
+// stores up to n overlapping intervals (in lo order) in out and returns how
+// many overlap. One pruned in-order walk with no re-descent per result: only
+// subtrees whose max_hi reaches lo are entered, and apart from the O(log n)
+// boundary path each of them holds a result, so k overlaps cost
+// O(log n + k log(n/k)), never more than O(n). Ordering by lo with max_hi
+// alone cannot reach O(log n + k).
+size_t rbtree_interval_stab(const rb_root *, const key_t lo, const key_t hi,
+                            rb_interval **out, const size_t n);
+
+#endif  // _RBTREE_INTERVAL_H_
@@ -0,0 +1,124 @@
+#include "rbtree_link.h"
+
+#include "rbtree_core.h"
+
+// 회전/fixup은 rbtree.c와 같은 rbtree_core.h의 코드를 caller의 struct에 박힌 rb_link 위에 찍어 낸 것.
+// sentinel이 없으므로 leaf는 NULL이고, augment 함수는 root와 함께 rb_ctx로 들고 다닌다.
+typedef struct {
+  rb_root *root;
+  rb_augment_fn aug;  // NULL이면 부가 정보 없음
+} rb_ctx;
+
+#define RB_LEAF(c) NULL
+#define RB_ROOT(c) ((c)->root->root)
+#define RB_PULL(c, x) ((c)->aug != NULL ? (c)->aug(x) : (void)0)
+
+// x부터 루트까지 부가 정보 갱신
+static void rb_augment_path(rb_ctx *c, rb_link *x)
+{
+  if (c->aug == NULL)
+  {
+    return;
+  }
+  for (; x != NULL; x = x->parent)
+  {
+    c->aug(x);
+  }
+}
+
+RB_CORE_DEFINE(rb, rb_ctx, rb_link, RB_LEAF, RB_ROOT, RB_PULL, rb_augment_path)
+
+void rb_link_node(rb_link *node, rb_link *parent, rb_link **link)
+{
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->color = RBTREE_RED;
+  *link = node;
+}
+
+void rb_insert_augmented(rb_root *root, rb_link *z, rb_augment_fn aug)
+{
+  rb_ctx c = {root, aug};
+  rb_augment_path(&c, z);           // 새 노드부터 루트까지 부가 정보 갱신 후 회전으로 색 맞춤
+  rb_insert_fixup(&c, z);
+}
+
+void rb_erase_augmented(rb_root *root, rb_link *z, rb_augment_fn aug)
+{
+  rb_ctx c = {root, aug};
+  rb_detach(&c, z);
+}
+
+void rb_insert_color(rb_root *root, rb_link *z)
+{
+  rb_insert_augmented(root, z, NULL);
+}
+
+void rb_erase(rb_root *root, rb_link *z)
+{
+  rb_erase_augmented(root, z, NULL);
+}
+
+rb_link *rb_first(const rb_root *root)
+{
+  rb_link *p = root->root;
+  if (p == NULL)
+  {
+    return NULL;
+  }
+  while (p->left != NULL)
+  {
+    p = p->left;
+  }
+  return p;
+}
+
+rb_link *rb_last(const rb_root *root)
+{
+  rb_link *p = root->root;
+  if (p == NULL)
+  {
+    return NULL;
+  }
+  while (p->right != NULL)
+  {
+    p = p->right;
+  }
+  return p;
+}
+
+rb_link *rb_next(const rb_link *p)
+{
+  if (p->right != NULL)             // 오른쪽 subtree의 가장 왼쪽
+  {
+    p = p->right;
+    while (p->left != NULL)
+    {
+      p = p->left;
+    }
+    return (rb_link *)p;
+  }
+  while (p->parent != NULL && p == p->parent->right) // 오른쪽에서 올라오는 동안 계속 올라감
+  {
+    p = p->parent;
+  }
+  return p->parent;
+}
+
+rb_link *rb_prev(const rb_link *p)
+{
+  if (p->left != NULL)
+  {
+    p = p->left;
+    while (p->right != NULL)
+    {
+      p = p->right;
+    }
+    return (rb_link *)p;
+  }
+  while (p->parent != NULL && p == p->parent->left)
+  {
+    p = p->parent;
+  }
+  return p->parent;
+}
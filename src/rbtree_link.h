@@ -0,0 +1,88 @@
+#ifndef _RBTREE_LINK_H_
+#define _RBTREE_LINK_H_
+
+#include <stddef.h>
+
+#include "rbtree.h"
+
+// Intrusive red-black tree (Linux kernel style).
+// Callers embed an rb_link in their own struct; insert/erase only relink and
+// never allocate. Leaves are NULL instead of a sentinel because the links live
+// in caller-owned memory.
+
+typedef struct rb_link {
+  struct rb_link *parent, *left, *right;
+  color_t color;
+} rb_link;
+
+typedef struct {
+  rb_link *root;
+} rb_root;
+
+#define RB_ROOT_INIT {NULL}
+
+// container_of: embedded rb_link -> enclosing struct
+#define rb_entry(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// link node as the child of parent at *link (as found by a descent), then
+// rb_insert_color() rebalances
+void rb_link_node(rb_link *node, rb_link *parent, rb_link **link);
+void rb_insert_color(rb_root *, rb_link *);
+void rb_erase(rb_root *, rb_link *);
+
+// Augmented trees keep per-node data derived from the subtree (e.g. the
+// interval tree's max end). aug recomputes one node from its children and is
+// called on every node whose subtree changes, including inside rotations.
+typedef void (*rb_augment_fn)(rb_link *);
+void rb_insert_augmented(rb_root *, rb_link *, rb_augment_fn);
+void rb_erase_augmented(rb_root *, rb_link *, rb_augment_fn);
+
+rb_link *rb_first(const rb_root *);
+rb_link *rb_last(const rb_root *);
+rb_link *rb_next(const rb_link *);
+rb_link *rb_prev(const rb_link *);
+
+// Generates typed insert/find/erase/first/next for `type` whose rb_link field
+// is `member`, ordered by the compile-time comparator `cmp(const type *, const
+// type *)` returning <0, 0, >0. Equal elements are inserted to the right, like
+// rbtree_insert.
+#define RB_DEFINE_INTRUSIVE(name, type, member, cmp)                          \
+  static inline type *name##_insert(rb_root *root, type *node) {              \
+    rb_link **link = &root->root, *parent = NULL;                             \
+    while (*link != NULL) {                                                   \
+      parent = *link;                                                         \
+      if (cmp(node, rb_entry(parent, type, member)) < 0) {                    \
+        link = &parent->left;                                                 \
+      } else {                                                                \
+        link = &parent->right;                                                \
+      }                                                                       \
+    }                                                                         \
+    rb_link_node(&node->member, parent, link);                                \
+    rb_insert_color(root, &node->member);                                     \
+    return node;                                                              \
+  }                                                                           \
+  static inline type *name##_find(const rb_root *root, const type *key) {     \
+    rb_link *cur = root->root;                                                \
+    while (cur != NULL) {                                                     \
+      int c = cmp(key, rb_entry(cur, type, member));                          \
+      if (c == 0) {                                                           \
+        return rb_entry(cur, type, member);                                   \
+      }                                                                       \
+      cur = (c < 0) ? cur->left : cur->right;                                 \
+    }                                                                         \
+    return NULL;                                                              \
+  }                                                                           \
+  static inline void name##_erase(rb_root *root, type *node) {                \
+    rb_erase(root, &node->member);                                            \
+  }                                                                           \
+  static inline type *name##_first(const rb_root *root) {                     \
+    rb_link *l = rb_first(root);                                              \
+    return l == NULL ? NULL : rb_entry(l, type, member);                      \
+  }                                                                           \
+  static inline type *name##_next(const type *node) {                         \
+    rb_link *l = rb_next(&node->member);                                      \
+    return l == NULL ? NULL : rb_entry(l, type, member);                      \
+  }
+
+#endif  // _RBTREE_LINK_H_
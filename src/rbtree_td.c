@@ -0,0 +1,340 @@
+#include "rbtree_td.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Julienne Walker의 top-down red-black tree 방식
+// 내려가면서 미리 색을 바꾸고 회전하므로 올라올 필요가 없어 parent pointer가 필요 없다.
+
+static int td_is_red(const td_node *x)
+{
+  return x != NULL && x->color == RBTREE_RED;
+}
+
+// root를 dir 방향으로 회전 (root의 !dir 자식이 새 root) 후 새 root를 반환
+static td_node *td_single(td_node *root, const int dir)
+{
+  td_node *save = root->link[!dir];
+  root->link[!dir] = save->link[dir];
+  save->link[dir] = root;
+  root->color = RBTREE_RED;
+  save->color = RBTREE_BLACK;
+  return save;
+}
+
+static td_node *td_double(td_node *root, const int dir)
+{
+  root->link[!dir] = td_single(root->link[!dir], !dir);
+  return td_single(root, dir);
+}
+
+rbtree_td *new_rbtree_td(void)
+{
+  rbtree_td *t = (rbtree_td *)calloc(1, sizeof(rbtree_td));
+  if (t == NULL)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return t;
+}
+
+void delete_rbtree_td(rbtree_td *t)
+{
+  // 왼쪽 자식을 오른쪽 회전으로 펴 가면서 재귀 없이 반환
+  td_node *x = t->root;
+  while (x != NULL)
+  {
+    if (x->link[0] != NULL)
+    {
+      td_node *l = x->link[0];
+      x->link[0] = l->link[1];
+      l->link[1] = x;
+      x = l;
+    }
+    else
+    {
+      td_node *next = x->link[1];
+      free(x);
+      x = next;
+    }
+  }
+  free(t);
+}
+
+static td_node *td_new_node(const key_t key)
+{
+  td_node *z = (td_node *)calloc(1, sizeof(td_node));
+  if (z == NULL)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  z->key = key;
+  z->color = RBTREE_RED;
+  return z;
+}
+
+td_node *rbtree_td_insert(rbtree_td *t, const key_t key)
+{
+  td_node *z = td_new_node(key);
+  t->size++;
+  if (t->root == NULL)
+  {
+    t->root = z;
+    z->color = RBTREE_BLACK;
+    return z;
+  }
+
+  td_node head = {0};               // 루트 위의 가짜 노드 (루트 회전도 같은 코드로 처리)
+  td_node *gg = &head;              // 증조부
+  td_node *g = NULL, *p = NULL;     // 조부, 부모
+  td_node *q = t->root;             // 현재 노드
+  int dir = 0, last = 0;
+  head.link[1] = t->root;
+
+  while (1)
+  {
+    if (q == NULL)                  // 빈 자리에 도착하면 새 노드를 붙임
+    {
+      p->link[dir] = q = z;
+    }
+    else if (td_is_red(q->link[0]) && td_is_red(q->link[1]))
+    {
+      // 내려가는 길에 자식 둘이 RED인 노드를 만나면 color flip
+      q->color = RBTREE_RED;
+      q->link[0]->color = RBTREE_BLACK;
+      q->link[1]->color = RBTREE_BLACK;
+    }
+
+    if (td_is_red(q) && td_is_red(p)) // red-red는 조부 기준 회전으로 바로 해결
+    {
+      int dir2 = gg->link[1] == g;
+      if (q == p->link[last])
+      {
+        gg->link[dir2] = td_single(g, !last);
+      }
+      else
+      {
+        gg->link[dir2] = td_double(g, !last);
+      }
+    }
+
+    if (q == z)
+    {
+      break;
+    }
+    last = dir;
+    dir = !(key < q->key);          // 같은 key는 오른쪽 (rbtree_insert와 같음)
+    if (g != NULL)
+    {
+      gg = g;
+    }
+    g = p;
+    p = q;
+    q = q->link[dir];
+  }
+
+  t->root = head.link[1];
+  t->root->color = RBTREE_BLACK;    // 루트는 항상 BLACK
+  return z;
+}
+
+td_node *rbtree_td_find(const rbtree_td *t, const key_t key)
+{
+  td_node *cur = t->root;
+  while (cur != NULL)
+  {
+    if (cur->key == key)
+    {
+      return cur;
+    }
+    cur = cur->link[cur->key < key];
+  }
+  return NULL;
+}
+
+int rbtree_td_erase(rbtree_td *t, const key_t key)
+{
+  // 내려가면서 현재 노드가 항상 RED가 되도록 RED를 밀어 내리고,
+  // 맨 아래 노드(찾은 노드의 중위 predecessor)를 떼어낸 뒤 그 key를 찾은 노드에 복사한다.
+  if (t->root == NULL)
+  {
+    return 0;
+  }
+  td_node head = {0};
+  td_node *q = &head, *p = NULL, *g = NULL;
+  td_node *found = NULL;
+  int dir = 1;
+  head.link[1] = t->root;
+
+  while (q->link[dir] != NULL)
+  {
+    int last = dir;
+    g = p;
+    p = q;
+    q = q->link[dir];
+    dir = q->key < key;             // 같은 key면 왼쪽으로 계속 (predecessor 찾기)
+    if (q->key == key)
+    {
+      found = q;
+    }
+
+    if (!td_is_red(q) && !td_is_red(q->link[dir]))
+    {
+      if (td_is_red(q->link[!dir]))
+      {
+        p = p->link[last] = td_single(q, dir);
+      }
+      else
+      {
+        td_node *s = p->link[!last];  // 형제
+        if (s != NULL)
+        {
+          if (!td_is_red(s->link[!last]) && !td_is_red(s->link[last]))
+          {
+            // color flip
+            p->color = RBTREE_BLACK;
+            s->color = RBTREE_RED;
+            q->color = RBTREE_RED;
+          }
+          else
+          {
+            int dir2 = g->link[1] == p;
+            if (td_is_red(s->link[last]))
+            {
+              g->link[dir2] = td_double(p, last);
+            }
+            else
+            {
+              g->link[dir2] = td_single(p, last);
+            }
+            q->color = g->link[dir2]->color = RBTREE_RED;
+            g->link[dir2]->link[0]->color = RBTREE_BLACK;
+            g->link[dir2]->link[1]->color = RBTREE_BLACK;
+          }
+        }
+      }
+    }
+  }
+
+  if (found != NULL)
+  {
+    found->key = q->key;
+    p->link[p->link[1] == q] = q->link[q->link[0] == NULL];
+    free(q);
+    t->size--;
+  }
+  t->root = head.link[1];
+  if (t->root != NULL)
+  {
+    t->root->color = RBTREE_BLACK;
+  }
+  return found != NULL;
+}
+
+td_node *rbtree_td_min(const rbtree_td *t)
+{
+  td_node *p = t->root;
+  while (p != NULL && p->link[0] != NULL)
+  {
+    p = p->link[0];
+  }
+  return p;
+}
+
+td_node *rbtree_td_max(const rbtree_td *t)
+{
+  td_node *p = t->root;
+  while (p != NULL && p->link[1] != NULL)
+  {
+    p = p->link[1];
+  }
+  return p;
+}
+
+// x부터 왼쪽 끝까지 경로를 stack에 쌓음
+static void td_push_left(rbtree_td_iter *it, td_node *x)
+{
+  while (x != NULL)
+  {
+    it->path[it->top++] = x;
+    x = x->link[0];
+  }
+}
+
+td_node *rbtree_td_first(const rbtree_td *t, rbtree_td_iter *it)
+{
+  it->top = 0;
+  td_push_left(it, t->root);
+  return rbtree_td_next(it);
+}
+
+td_node *rbtree_td_next(rbtree_td_iter *it)
+{
+  // stack 맨 위가 다음 노드, 그 오른쪽 subtree의 왼쪽 경로를 대신 쌓아 둠
+  if (it->top == 0)
+  {
+    return NULL;
+  }
+  td_node *x = it->path[--it->top];
+  td_push_left(it, x->link[1]);
+  return x;
+}
+
+int rbtree_td_to_array(const rbtree_td *t, key_t *arr, const size_t n)
+{
+  rbtree_td_iter it;
+  size_t i = 0;
+  for (td_node *p = rbtree_td_first(t, &it); p != NULL && i < n; p = rbtree_td_next(&it))
+  {
+    arr[i++] = p->key;
+  }
+  return 0;
+}
+
+// x subtree의 black height (위반이 있으면 -1), 깊이는 RBTREE_TD_MAX_HEIGHT로 제한됨
+static int td_check(const td_node *x, const td_node *lo, const td_node *hi, rbtree_check_t *err, size_t *count)
+{
+  if (x == NULL)
+  {
+    return 0;
+  }
+  (*count)++;
+  if ((lo != NULL && x->key < lo->key) || (hi != NULL && x->key > hi->key))
+  {
+    *err = RBTREE_INVALID_ORDER;
+    return -1;
+  }
+  if (td_is_red(x) && (td_is_red(x->link[0]) || td_is_red(x->link[1])))
+  {
+    *err = RBTREE_INVALID_RED;
+    return -1;
+  }
+  int l = td_check(x->link[0], lo, x, err, count);
+  int r = td_check(x->link[1], x, hi, err, count);
+  if (l < 0 || r < 0)
+  {
+    return -1;
+  }
+  if (l != r)
+  {
+    *err = RBTREE_INVALID_BLACK;
+    return -1;
+  }
+  return l + (x->color == RBTREE_BLACK);
+}
+
+rbtree_check_t rbtree_td_validate(const rbtree_td *t)
+{
+  if (td_is_red(t->root))
+  {
+    return RBTREE_INVALID_ROOT;
+  }
+  rbtree_check_t err = RBTREE_VALID;
+  size_t count = 0;
+  if (td_check(t->root, NULL, NULL, &err, &count) < 0)
+  {
+    return err;
+  }
+  return count == t->size ? RBTREE_VALID : RBTREE_INVALID_COUNT;
+}
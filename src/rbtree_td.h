@@ -0,0 +1,49 @@
+#ifndef _RBTREE_TD_H_
+#define _RBTREE_TD_H_
+
+#include "rbtree.h"
+
+// Parent-pointer-free red-black tree with single-pass top-down insert/erase.
+// Rebalancing happens on the way down, so no node needs a parent link: nodes
+// are 24 bytes instead of node_t's 32 and rotations touch fewer cache lines.
+// Iteration keeps the root path on a bounded stack instead.
+//
+// Erase is by key: the node holding the in-order predecessor is unlinked and
+// its key copied into the matching node, so node pointers returned earlier
+// are only valid until the next erase.
+
+typedef struct td_node {
+  key_t key;
+  color_t color;
+  struct td_node *link[2];  // [0] left, [1] right
+} td_node;
+
+typedef struct {
+  td_node *root;
+  size_t size;
+} rbtree_td;
+
+// height of a red-black tree with n < 2^64 nodes is below 2 * 64
+#define RBTREE_TD_MAX_HEIGHT 128
+
+typedef struct {
+  td_node *path[RBTREE_TD_MAX_HEIGHT];
+  int top;
+} rbtree_td_iter;
+
+rbtree_td *new_rbtree_td(void);
+void delete_rbtree_td(rbtree_td *);
+
+td_node *rbtree_td_insert(rbtree_td *, const key_t);
+td_node *rbtree_td_find(const rbtree_td *, const key_t);
+int rbtree_td_erase(rbtree_td *, const key_t);
+td_node *rbtree_td_min(const rbtree_td *);
+td_node *rbtree_td_max(const rbtree_td *);
+
+td_node *rbtree_td_first(const rbtree_td *, rbtree_td_iter *);
+td_node *rbtree_td_next(rbtree_td_iter *);
+int rbtree_td_to_array(const rbtree_td *, key_t *, const size_t);
+
+rbtree_check_t rbtree_td_validate(const rbtree_td *);
+
+#endif  // _RBTREE_TD_H_
@@ -0,0 +1,41 @@
+// Micro-benchmark: ascending (timestamp-like) appends through rbtree_insert
+// versus rbtree_insert_hint with the previously inserted node as the hint.
+// The hinted path must not be slower; exits non-zero if it is clearly so.
+//
+//   ./bench-rbtree [n]
+#include <rbtree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double append(const unsigned int mode, const int n, const int hinted) {
+  rbtree *t = new_rbtree_mode(mode);
+  node_t *last = NULL;
+  double start = now();
+  for (int i = 0; i < n; i++) {
+    last = hinted ? rbtree_insert_hint(t, last, i) : rbtree_insert(t, i);
+  }
+  double elapsed = now() - start;
+  delete_rbtree(t);
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  const int n = argc > 1 ? atoi(argv[1]) : 5000000;
+  const unsigned int modes[] = {0, RBTREE_MODE_COUNTED};
+  const char *names[] = {"plain", "counted"};
+  int slow = 0;
+  for (int m = 0; m < 2; m++) {
+    double plain = append(modes[m], n, 0);
+    double hint = append(modes[m], n, 1);
+    printf("%-8s %d ascending appends: insert %.3fs, insert_hint %.3fs\n", names[m], n, plain, hint);
+    slow |= hint > plain * 1.25 + 0.01;
+  }
+  return slow;
+}
@@ -0,0 +1,548 @@
+// Differential fuzz / stress driver for rbtree.
+//
+// Decodes a byte string into a sequence of insert/find/erase/min/max/to_array
+// operations, applies it to every tree mode and to a trivially correct
+// reference (a sorted array), and aborts on the first disagreement or
+// rbtree_validate() failure.
+//
+//   libFuzzer: make libfuzzer && ./fuzz-rbtree-libfuzzer
+//   AFL:       afl-fuzz -i in -o out ./fuzz-rbtree @@   (or "-" for stdin)
+//   stress:    ./fuzz-rbtree [rounds] [seed]
+#include <assert.h>
+#include <rbtree.h>
+#include <rbtree_interval.h>
+#include <rbtree_link.h>
+#include <rbtree_td.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_RANGE 512
+#define OP_BYTES 3
+#define STRESS_INPUT 4096
+
+// every storage mode the differential test runs against
+typedef struct {
+  const char *name;
+  rbtree *(*create)(void);
+  size_t capacity;  // top-K bound the mode sets (0 = unbounded)
+} fuzz_mode;
+
+static rbtree *create_plain(void) { return new_rbtree(); }
+static rbtree *create_counted(void) { return new_rbtree_mode(RBTREE_MODE_COUNTED); }
+static rbtree *create_indexed(void) { return new_rbtree_mode(RBTREE_MODE_INDEXED); }
+static rbtree *create_counted_indexed(void) {
+  return new_rbtree_mode(RBTREE_MODE_COUNTED | RBTREE_MODE_INDEXED);
+}
+
+#define TOP_K 48
+static rbtree *create_top_k(void) {
+  rbtree *t = new_rbtree_mode(RBTREE_MODE_INDEXED);
+  rbtree_set_capacity(t, TOP_K);
+  return t;
+}
+static rbtree *create_counted_top_k(void) {
+  rbtree *t = new_rbtree_mode(RBTREE_MODE_COUNTED);
+  rbtree_set_capacity(t, TOP_K);
+  return t;
+}
+
+static rbtree *create_arena_counted(void) {
+  return new_rbtree_mode(RBTREE_MODE_ARENA | RBTREE_MODE_COUNTED);
+}
+static rbtree *create_hugepage_indexed(void) {
+  return new_rbtree_mode(RBTREE_MODE_HUGEPAGE | RBTREE_MODE_INDEXED);
+}
+
+static const fuzz_mode modes[] = {
+    {"plain", create_plain, 0},
+    {"counted", create_counted, 0},
+    {"indexed", create_indexed, 0},
+    {"counted+indexed", create_counted_indexed, 0},
+    {"top-k", create_top_k, TOP_K},
+    {"counted+top-k", create_counted_top_k, TOP_K},
+    {"arena+counted", create_arena_counted, 0},
+    {"hugepage+indexed", create_hugepage_indexed, 0},
+};
+
+// the top-down, intrusive and interval trees have their own types
+static const fuzz_mode td_mode = {"top-down", NULL, 0};
+static const fuzz_mode link_mode = {"intrusive", NULL, 0};
+static const fuzz_mode interval_mode = {"interval", NULL, 0};
+
+typedef struct {
+  rb_link link;
+  key_t key;
+} link_item;
+
+static int link_cmp(const link_item *a, const link_item *b) {
+  return (a->key > b->key) - (a->key < b->key);
+}
+
+RB_DEFINE_INTRUSIVE(fz, link_item, link, link_cmp)
+
+// reference ordered multiset: sorted array
+typedef struct {
+  key_t *keys;
+  size_t n;
+} ref_set;
+
+static size_t ref_lower_bound(const ref_set *r, const key_t key) {
+  size_t lo = 0, hi = r->n;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (r->keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void ref_insert(ref_set *r, const key_t key) {
+  size_t i = ref_lower_bound(r, key);
+  memmove(r->keys + i + 1, r->keys + i, (r->n - i) * sizeof(key_t));
+  r->keys[i] = key;
+  r->n++;
+}
+
+static size_t ref_count(const ref_set *r, const key_t key) {
+  size_t i = ref_lower_bound(r, key), c = 0;
+  while (i + c < r->n && r->keys[i + c] == key) {
+    c++;
+  }
+  return c;
+}
+
+static void ref_erase(ref_set *r, const key_t key) {
+  size_t i = ref_lower_bound(r, key);
+  memmove(r->keys + i, r->keys + i + 1, (r->n - i - 1) * sizeof(key_t));
+  r->n--;
+}
+
+// reference side of an insert: with a capacity, keys not above the minimum of
+// a full set are rejected and otherwise the minimum is evicted
+static int ref_insert_bounded(ref_set *r, const size_t capacity, const key_t key) {
+  if (capacity != 0 && r->n >= capacity) {
+    if (key <= r->keys[0]) {
+      return 0;
+    }
+    ref_erase(r, r->keys[0]);
+  }
+  ref_insert(r, key);
+  return 1;
+}
+
+static void fail(const fuzz_mode *mode, const size_t step, const char *what) {
+  fprintf(stderr, "fuzz-rbtree: mode %s, op %zu: %s\n", mode->name, step, what);
+  abort();
+}
+
+#define CHECK(cond)                     \
+  do {                                  \
+    if (!(cond)) {                      \
+      fail(mode, step, #cond);          \
+    }                                   \
+  } while (0)
+
+static void run_mode(const fuzz_mode *mode, const uint8_t *data, const size_t size) {
+  const size_t ops = size / OP_BYTES;
+  rbtree *t = mode->create();
+  ref_set ref = {calloc(ops + 1, sizeof(key_t)), 0};
+  key_t *arr = calloc(ops + 1, sizeof(key_t));
+  node_t *last = NULL;  // hint/finger for the locality ops, dropped on erase
+
+  for (size_t step = 0; step < ops; step++) {
+    const uint8_t *op = data + step * OP_BYTES;
+    const key_t key = (key_t)((op[1] | op[2] << 8) % KEY_RANGE) - KEY_RANGE / 2;
+
+    switch (op[0] % 13) {
+      case 0: {  // insert
+        node_t *p = rbtree_insert(t, key);
+        CHECK((p != NULL) == ref_insert_bounded(&ref, mode->capacity, key));
+        CHECK(p == NULL || p->key == key);
+        last = p != NULL ? p : last;
+        break;
+      }
+      case 1: {  // hinted insert
+        node_t *p = rbtree_insert_hint(t, last, key);
+        CHECK((p != NULL) == ref_insert_bounded(&ref, mode->capacity, key));
+        CHECK(p == NULL || p->key == key);
+        last = p != NULL ? p : last;
+        break;
+      }
+      case 2: {  // find
+        node_t *p = rbtree_find(t, key);
+        CHECK((p != NULL) == (ref_count(&ref, key) > 0));
+        CHECK(p == NULL || p->key == key);
+        break;
+      }
+      case 3: {  // finger search
+        node_t *p = rbtree_find_from(t, last, key);
+        CHECK((p != NULL) == (ref_count(&ref, key) > 0));
+        CHECK(p == NULL || p->key == key);
+        break;
+      }
+      case 4: {  // erase
+        node_t *p = rbtree_find(t, key);
+        if (p != NULL) {
+          rbtree_erase(t, p);
+          ref_erase(&ref, key);
+          last = NULL;
+        }
+        break;
+      }
+      case 5: {  // min/max (erase one of them every other time)
+        node_t *lo = rbtree_min(t), *hi = rbtree_max(t);
+        CHECK((lo == NULL) == (ref.n == 0));
+        CHECK((hi == NULL) == (ref.n == 0));
+        if (ref.n > 0) {
+          CHECK(lo->key == ref.keys[0]);
+          CHECK(hi->key == ref.keys[ref.n - 1]);
+          if (key & 1) {
+            rbtree_erase(t, (key & 2) ? lo : hi);
+            ref_erase(&ref, (key & 2) ? ref.keys[0] : ref.keys[ref.n - 1]);
+            last = NULL;
+          }
+        }
+        break;
+      }
+      case 6: {  // to_array, sometimes truncated
+        size_t n = (key & 1) ? ref.n : ref.n / 2;
+        rbtree_to_array(t, arr, n);
+        CHECK(memcmp(arr, ref.keys, n * sizeof(key_t)) == 0);
+        break;
+      }
+      case 7: {  // count
+        CHECK(rbtree_count(t, key) == ref_count(&ref, key));
+        break;
+      }
+      case 8: {  // batched lookup of a few neighbouring keys
+        key_t keys[4] = {key, key + 1, key - 1, key + 7};
+        node_t *out[4];
+        size_t found = rbtree_find_many(t, keys, 4, out), expected = 0;
+        for (int i = 0; i < 4; i++) {
+          CHECK((out[i] != NULL) == (ref_count(&ref, keys[i]) > 0));
+          CHECK(out[i] == NULL || out[i]->key == keys[i]);
+          expected += (out[i] != NULL);
+        }
+        CHECK(found == expected);
+        break;
+      }
+      case 9: {  // range erase of a small window
+        const key_t hi = key + (op[0] >> 4);
+        size_t kept = 0;
+        for (size_t i = 0; i < ref.n; i++) {
+          if (ref.keys[i] < key || ref.keys[i] > hi) {
+            ref.keys[kept++] = ref.keys[i];
+          }
+        }
+        CHECK(rbtree_erase_range(t, key, hi) == ref.n - kept);
+        ref.n = kept;
+        last = NULL;
+        break;
+      }
+      case 10: {  // drop the k smallest keys
+        size_t k = op[1] % 8;
+        k = k > ref.n ? ref.n : k;
+        CHECK(rbtree_erase_min_n(t, op[1] % 8) == k);
+        memmove(ref.keys, ref.keys + k, (ref.n - k) * sizeof(key_t));
+        ref.n -= k;
+        last = NULL;
+        break;
+      }
+      case 11: {  // range aggregate (sum of keys) over a window
+#ifdef RBTREE_AUGMENT
+        const key_t hi = key + op[0];
+        agg_t sum = 0;
+        for (size_t i = ref_lower_bound(&ref, key); i < ref.n && ref.keys[i] <= hi; i++) {
+          sum += ref.keys[i];
+        }
+        CHECK(rbtree_aggregate(t, key, hi) == sum);
+#endif
+        break;
+      }
+      case 12: {  // a slice of online compaction (moves nodes)
+        rbtree_compact_stats st;
+        const int done = rbtree_compact(t, op[1] % 32, &st);
+        CHECK(st.done == done && st.moved <= op[1] % 32);
+        CHECK(st.locality >= 0.0 && st.locality <= 1.0);
+        last = NULL;
+        break;
+      }
+    }
+    CHECK(rbtree_size(t) == ref.n);
+    CHECK(rbtree_validate(t) == RBTREE_VALID);
+    if (!(t->mode & RBTREE_MODE_COUNTED)) {  // one node per key
+      rbtree_memory mu;
+      rbtree_memory_usage(t, &mu);
+      CHECK(mu.nodes == ref.n * sizeof(node_t));
+      CHECK(mu.fragmentation <= mu.slab_bytes);  // no underflow in the slab accounting
+    }
+  }
+
+  free(arr);
+  free(ref.keys);
+  delete_rbtree(t);
+}
+
+static void run_td(const uint8_t *data, const size_t size) {
+  const fuzz_mode *mode = &td_mode;
+  const size_t ops = size / OP_BYTES;
+  rbtree_td *t = new_rbtree_td();
+  ref_set ref = {calloc(ops + 1, sizeof(key_t)), 0};
+  key_t *arr = calloc(ops + 1, sizeof(key_t));
+
+  for (size_t step = 0; step < ops; step++) {
+    const uint8_t *op = data + step * OP_BYTES;
+    const key_t key = (key_t)((op[1] | op[2] << 8) % KEY_RANGE) - KEY_RANGE / 2;
+
+    switch (op[0] % 5) {
+      case 0:
+      case 1: {  // insert
+        td_node *p = rbtree_td_insert(t, key);
+        CHECK(p != NULL && p->key == key);
+        ref_insert(&ref, key);
+        break;
+      }
+      case 2: {  // find
+        td_node *p = rbtree_td_find(t, key);
+        CHECK((p != NULL) == (ref_count(&ref, key) > 0));
+        CHECK(p == NULL || p->key == key);
+        break;
+      }
+      case 3: {  // erase by key
+        const int had = ref_count(&ref, key) > 0;
+        CHECK(rbtree_td_erase(t, key) == had);
+        if (had) {
+          ref_erase(&ref, key);
+        }
+        break;
+      }
+      case 4: {  // min/max and to_array
+        td_node *lo = rbtree_td_min(t), *hi = rbtree_td_max(t);
+        CHECK((lo == NULL) == (ref.n == 0));
+        CHECK(ref.n == 0 || (lo->key == ref.keys[0] && hi->key == ref.keys[ref.n - 1]));
+        rbtree_td_to_array(t, arr, ref.n);
+        CHECK(memcmp(arr, ref.keys, ref.n * sizeof(key_t)) == 0);
+        break;
+      }
+    }
+    CHECK(t->size == ref.n);
+    CHECK(rbtree_td_validate(t) == RBTREE_VALID);
+  }
+
+  free(arr);
+  free(ref.keys);
+  delete_rbtree_td(t);
+}
+
+// black height of the subtree at x, or -1 on a bad parent link, red-red or
+// black-height mismatch
+static int link_check(const rb_link *x, const rb_link *parent) {
+  if (x == NULL) {
+    return 0;
+  }
+  if (x->parent != parent) {
+    return -1;
+  }
+  if (x->color == RBTREE_RED && parent != NULL && parent->color == RBTREE_RED) {
+    return -1;
+  }
+  int l = link_check(x->left, x), r = link_check(x->right, x);
+  if (l < 0 || r < 0 || l != r) {
+    return -1;
+  }
+  return l + (x->color == RBTREE_BLACK);
+}
+
+static void run_link(const uint8_t *data, const size_t size) {
+  const fuzz_mode *mode = &link_mode;
+  const size_t ops = size / OP_BYTES;
+  rb_root root = RB_ROOT_INIT;
+  link_item *items = calloc(ops + 1, sizeof(link_item));
+  size_t used = 0;
+  ref_set ref = {calloc(ops + 1, sizeof(key_t)), 0};
+
+  for (size_t step = 0; step < ops; step++) {
+    const uint8_t *op = data + step * OP_BYTES;
+    const key_t key = (key_t)((op[1] | op[2] << 8) % KEY_RANGE) - KEY_RANGE / 2;
+    link_item probe = {.key = key};
+
+    switch (op[0] % 5) {
+      case 0:
+      case 1: {  // insert
+        items[used].key = key;
+        CHECK(fz_insert(&root, &items[used]) == &items[used]);
+        used++;
+        ref_insert(&ref, key);
+        break;
+      }
+      case 2: {  // find
+        link_item *p = fz_find(&root, &probe);
+        CHECK((p != NULL) == (ref_count(&ref, key) > 0));
+        CHECK(p == NULL || p->key == key);
+        break;
+      }
+      case 3: {  // erase
+        link_item *p = fz_find(&root, &probe);
+        if (p != NULL) {
+          fz_erase(&root, p);
+          ref_erase(&ref, key);
+        }
+        break;
+      }
+      case 4: {  // in-order walk both ways
+        size_t i = 0;
+        for (link_item *p = fz_first(&root); p != NULL; p = fz_next(p), i++) {
+          CHECK(i < ref.n && p->key == ref.keys[i]);
+        }
+        CHECK(i == ref.n);
+        for (rb_link *l = rb_last(&root); l != NULL; l = rb_prev(l)) {
+          CHECK(i > 0 && rb_entry(l, link_item, link)->key == ref.keys[--i]);
+        }
+        CHECK(i == 0);
+        break;
+      }
+    }
+    CHECK(root.root == NULL || root.root->color == RBTREE_BLACK);
+    CHECK(link_check(root.root, NULL) >= 0);
+    CHECK((root.root == NULL) == (ref.n == 0));
+  }
+
+  free(ref.keys);
+  free(items);
+}
+
+// max_hi of every node must be the largest hi in its subtree
+static int interval_max_ok(const rb_link *x) {
+  if (x == NULL) {
+    return 1;
+  }
+  const rb_interval *v = rb_entry(x, rb_interval, link);
+  key_t m = v->hi;
+  if (x->left != NULL && rb_entry(x->left, rb_interval, link)->max_hi > m) {
+    m = rb_entry(x->left, rb_interval, link)->max_hi;
+  }
+  if (x->right != NULL && rb_entry(x->right, rb_interval, link)->max_hi > m) {
+    m = rb_entry(x->right, rb_interval, link)->max_hi;
+  }
+  return v->max_hi == m && interval_max_ok(x->left) && interval_max_ok(x->right);
+}
+
+static void run_interval(const uint8_t *data, const size_t size) {
+  const fuzz_mode *mode = &interval_mode;
+  const size_t ops = size / OP_BYTES;
+  rb_root root = RB_ROOT_INIT;
+  rb_interval *items = calloc(ops + 1, sizeof(rb_interval));
+  uint8_t *live = calloc(ops + 1, 1);
+  rb_interval **out = calloc(ops + 1, sizeof(rb_interval *));
+  size_t used = 0;
+
+  for (size_t step = 0; step < ops; step++) {
+    const uint8_t *op = data + step * OP_BYTES;
+    const key_t key = (key_t)((op[1] | op[2] << 8) % KEY_RANGE) - KEY_RANGE / 2;
+
+    switch (op[0] % 3) {
+      case 0: {  // insert [key, key + len]
+        items[used].lo = key;
+        items[used].hi = key + (op[0] >> 2);
+        rbtree_interval_insert(&root, &items[used]);
+        live[used++] = 1;
+        break;
+      }
+      case 1: {  // erase some live interval
+        if (used > 0) {
+          size_t i = (size_t)(op[1] | op[2] << 8) % used;
+          if (live[i]) {
+            rbtree_interval_erase(&root, &items[i]);
+            live[i] = 0;
+          }
+        }
+        break;
+      }
+      case 2: {  // stab [key, key + w] against a linear scan
+        const key_t hi = key + (op[0] >> 4);
+        size_t expected = 0;
+        for (size_t i = 0; i < used; i++) {
+          expected += live[i] && items[i].lo <= hi && items[i].hi >= key;
+        }
+        size_t found = rbtree_interval_stab(&root, key, hi, out, ops + 1);
+        CHECK(found == expected);
+        for (size_t i = 0; i < found; i++) {
+          CHECK(live[out[i] - items] && out[i]->lo <= hi && out[i]->hi >= key);
+          CHECK(i == 0 || out[i - 1]->lo <= out[i]->lo);
+        }
+        CHECK((rbtree_interval_overlap(&root, key, hi) != NULL) == (expected > 0));
+        break;
+      }
+    }
+    CHECK(root.root == NULL || root.root->color == RBTREE_BLACK);
+    CHECK(link_check(root.root, NULL) >= 0);
+    CHECK(interval_max_ok(root.root));
+  }
+
+  free(out);
+  free(live);
+  free(items);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    run_mode(&modes[m], data, size);
+  }
+  run_td(data, size);
+  run_link(data, size);
+  run_interval(data, size);
+  return 0;
+}
+
+#ifndef RBTREE_LIBFUZZER
+static int run_file(const char *path) {
+  FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+  size_t cap = 1 << 16, size = 0, r;
+  uint8_t *data = malloc(cap);
+  while ((r = fread(data + size, 1, cap - size, f)) > 0) {
+    size += r;
+    if (size == cap) {
+      cap *= 2;
+      data = realloc(data, cap);
+    }
+  }
+  if (f != stdin) {
+    fclose(f);
+  }
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  // a non-numeric argument is an input file (AFL), otherwise run random rounds
+  if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+    return run_file(argv[1]);
+  }
+  const long rounds = argc > 1 ? atol(argv[1]) : 1000;
+  const unsigned int seed = argc > 2 ? (unsigned int)atol(argv[2]) : 1;
+
+  srand(seed);
+  uint8_t *data = malloc(STRESS_INPUT);
+  for (long i = 0; i < rounds; i++) {
+    // vary the length so that trees of many sizes get exercised
+    size_t size = (size_t)rand() % STRESS_INPUT;
+    for (size_t j = 0; j < size; j++) {
+      data[j] = (uint8_t)rand();
+    }
+    LLVMFuzzerTestOneInput(data, size);
+  }
+  free(data);
+  printf("Passed %ld stress rounds (seed %u)\n", rounds, seed);
+  return 0;
+}
+#endif
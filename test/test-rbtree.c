@@ -1,8 +1,14 @@
 #include <assert.h>
+#include <pthread.h>
 #include <rbtree.h>
+#include <rbtree_link.h>
+#include <rbtree_interval.h>
+#include <rbtree_combine.h>
+#include <rbtree_td.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 
@@ -331,6 +337,7 @@ void test_rb_constraints(const key_t arr[], const size_t n) {
 
   test_color_constraint(t);
   test_search_constraint(t);
+  assert(rbtree_validate(t) == RBTREE_VALID);
 
   delete_rbtree(t);
 }
@@ -422,6 +429,748 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+// find_many should return the same nodes as calling find for each key
+void test_find_many(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(2 * n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (4 * n);
+    rbtree_insert(t, arr[i]);
+  }
+  for (int i = n; i < 2 * n; i++) {
+    arr[i] = rand() % (4 * n);
+  }
+
+  node_t **res = calloc(2 * n, sizeof(node_t *));
+  size_t found = rbtree_find_many(t, arr, 2 * n, res);
+  size_t expected = 0;
+  for (int i = 0; i < 2 * n; i++) {
+    assert(res[i] == rbtree_find(t, arr[i]));
+    if (res[i] != NULL) {
+      assert(res[i]->key == arr[i]);
+      expected++;
+    }
+  }
+  assert(found == expected);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// hinted insert and finger search should agree with the root-based versions
+void test_insert_hint(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  node_t *hint = NULL;
+  for (int i = 0; i < n; i++) {
+    // mostly ascending keys with some jitter and duplicates
+    arr[i] = i + rand() % 8 - 4;
+    hint = rbtree_insert_hint(t, hint, arr[i]);
+    assert(hint != NULL);
+    assert(hint->key == arr[i]);
+    nodes[i] = hint;
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  assert(rbtree_min(t)->key == arr[0]);
+  assert(rbtree_max(t)->key == arr[n - 1]);
+
+  for (int i = 0; i < n; i++) {
+    node_t *finger = nodes[rand() % n];
+    node_t *p = rbtree_find_from(t, finger, arr[i]);
+    assert(p != NULL);
+    assert(p->key == arr[i]);
+    assert(rbtree_find_from(t, finger, arr[n - 1] + 1 + i) == NULL);
+    assert(rbtree_find_from(t, finger, arr[0] - 1 - i) == NULL);
+  }
+
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  // erasing the extremes should keep the cached min/max in sync
+  rbtree_erase(t, rbtree_min(t));
+  rbtree_erase(t, rbtree_max(t));
+  assert(rbtree_min(t)->key == arr[1]);
+  assert(rbtree_max(t)->key == arr[n - 2]);
+
+  free(res);
+  free(nodes);
+  free(arr);
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  assert(rbtree_min(t) == NULL);
+  assert(rbtree_max(t) == NULL);
+  delete_rbtree(t);
+}
+
+// counted mode should store one node per distinct key and expand counts
+void test_counted(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(RBTREE_MODE_COUNTED);
+  rbtree *ref = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % 16;
+    node_t *p = rbtree_insert(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+    rbtree_insert(ref, arr[i]);
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+  assert(rbtree_size(t) == n);
+#ifndef RBTREE_AUGMENT
+  // the multiplicity must not grow the node: color, count and key share two words
+  assert(sizeof(node_t) == 2 * sizeof(int) + 3 * sizeof(node_t *));
+#endif
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  for (key_t k = -1; k <= 16; k++) {
+    assert(rbtree_count(t, k) == rbtree_count(ref, k));
+    node_t *p = rbtree_find(t, k);
+    assert(p == NULL || p->count == rbtree_count(t, k));
+  }
+
+  // erase drops one occurrence at a time
+  for (int i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, arr[i]);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+    assert(rbtree_size(t) == n - i - 1);
+  }
+  assert(rbtree_min(t) == NULL);
+
+  free(res);
+  free(arr);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+// validate should accept valid trees and catch broken invariants
+void test_validate(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % n);
+    if (i % 64 == 0) {
+      assert(rbtree_validate(t) == RBTREE_VALID);
+    }
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  node_t *root = t->root;
+  root->color = RBTREE_RED;
+  assert(rbtree_validate(t) == RBTREE_INVALID_ROOT);
+  root->color = RBTREE_BLACK;
+
+  node_t *p = root->left;
+  node_t *saved = p->parent;
+  p->parent = root->right;
+  assert(rbtree_validate(t) == RBTREE_INVALID_PARENT);
+  p->parent = saved;
+
+  key_t key = p->key;
+  p->key = root->key + 1;
+  assert(rbtree_validate(t) == RBTREE_INVALID_ORDER);
+  p->key = key;
+
+  p = rbtree_min(t);
+  color_t color = p->color;
+  p->color = color == RBTREE_RED ? RBTREE_BLACK : RBTREE_RED;
+  rbtree_check_t r = rbtree_validate(t);
+  assert(r == RBTREE_INVALID_RED || r == RBTREE_INVALID_BLACK);
+  p->color = color;
+
+  t->size++;
+  assert(rbtree_validate(t) == RBTREE_INVALID_COUNT);
+  t->size--;
+
+  node_t *max = t->max;
+  t->max = t->min;
+  assert(rbtree_validate(t) == RBTREE_INVALID_MINMAX);
+  t->max = max;
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  while (t->root != t->nil) {
+    rbtree_erase(t, t->root);
+    if (rbtree_size(t) % 64 == 0) {
+      assert(rbtree_validate(t) == RBTREE_VALID);
+    }
+  }
+  delete_rbtree(t);
+}
+
+// range erase and erase_min_n should drop exactly the selected keys
+void test_erase_range(const size_t n, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(mode);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % n;
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  size_t m = n;
+
+  for (int round = 0; round < 20 && m > 0; round++) {
+    key_t lo = rand() % n - 10, hi = lo + rand() % (n / 8);
+    size_t kept = 0;
+    for (size_t i = 0; i < m; i++) {
+      if (arr[i] < lo || arr[i] > hi) {
+        arr[kept++] = arr[i];
+      }
+    }
+    assert(rbtree_erase_range(t, lo, hi) == m - kept);
+    m = kept;
+    assert(rbtree_validate(t) == RBTREE_VALID);
+    assert(rbtree_size(t) == m);
+    rbtree_to_array(t, res, m);
+    for (size_t i = 0; i < m; i++) {
+      assert(arr[i] == res[i]);
+    }
+  }
+  assert(rbtree_erase_range(t, 5, 4) == 0);
+
+  while (m > 0) {
+    size_t k = 1 + rand() % (n / 10);
+    k = k > m ? m : k;
+    assert(rbtree_erase_min_n(t, k) == k);
+    memmove(arr, arr + k, (m - k) * sizeof(key_t));
+    m -= k;
+    assert(rbtree_validate(t) == RBTREE_VALID);
+    rbtree_to_array(t, res, m);
+    for (size_t i = 0; i < m; i++) {
+      assert(arr[i] == res[i]);
+    }
+  }
+  assert(t->root == t->nil);
+  assert(rbtree_erase_min_n(t, 3) == 0);
+
+  // a partially consumed run of one key: counted mode drops the copies from
+  // the node's count in one step and keeps the node
+  for (int i = 0; i < 1000; i++) {
+    rbtree_insert(t, 7);
+  }
+  node_t *seven = rbtree_find(t, 7);
+  assert(rbtree_erase_min_n(t, 999) == 999);
+  assert(rbtree_size(t) == 1 && rbtree_count(t, 7) == 1);
+  assert(!(mode & RBTREE_MODE_COUNTED) || t->root == seven);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_AUGMENT
+static agg_t brute_aggregate(const key_t *arr, const size_t n, const key_t lo, const key_t hi) {
+  agg_t sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (arr[i] >= lo && arr[i] <= hi) {
+      sum += arr[i];
+    }
+  }
+  return sum;
+}
+
+// range aggregate (default monoid: sum of keys) should match a linear scan
+void test_aggregate(const size_t n, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(mode);
+  key_t *arr = calloc(n, sizeof(key_t));
+  assert(rbtree_aggregate(t, 0, 10) == 0);
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % n - n / 4);
+  }
+  for (int i = 0; i < n / 4; i++) {
+    node_t *p = rbtree_find(t, rbtree_min(t)->key + rand() % 10);
+    rbtree_erase(t, p != NULL ? p : rbtree_max(t));
+  }
+  rbtree_erase_range(t, n / 3, n / 3 + 20);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  size_t m = rbtree_size(t);
+  rbtree_to_array(t, arr, m);
+  for (int i = 0; i < 200; i++) {
+    key_t lo = rand() % n - n / 2, hi = lo + rand() % n;
+    assert(rbtree_aggregate(t, lo, hi) == brute_aggregate(arr, m, lo, hi));
+  }
+  assert(rbtree_aggregate(t, 5, 4) == 0);
+  assert(t->root->agg == brute_aggregate(arr, m, arr[0], arr[m - 1]));
+
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
+// intrusive tree: items own their links, the tree never allocates
+struct item {
+  int value;
+  rb_link link;
+  int payload;
+};
+
+static int item_cmp(const struct item *a, const struct item *b) {
+  return (a->value > b->value) - (a->value < b->value);
+}
+
+RB_DEFINE_INTRUSIVE(item_tree, struct item, link, item_cmp)
+
+static int link_black_height(const rb_link *p, const rb_link *parent) {
+  if (p == NULL) {
+    return 0;
+  }
+  assert(p->parent == parent);
+  assert(!(p->color == RBTREE_RED && parent != NULL && parent->color == RBTREE_RED));
+  int l = link_black_height(p->left, p);
+  int r = link_black_height(p->right, p);
+  assert(l == r);
+  return l + (p->color == RBTREE_BLACK);
+}
+
+void test_intrusive(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rb_root root = RB_ROOT_INIT;
+  struct item *items = calloc(n, sizeof(struct item));
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    items[i].value = arr[i] = rand() % n;
+    items[i].payload = i;
+    item_tree_insert(&root, &items[i]);
+  }
+  assert(root.root->color == RBTREE_BLACK);
+  link_black_height(root.root, NULL);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  int i = 0;
+  for (struct item *p = item_tree_first(&root); p != NULL; p = item_tree_next(p)) {
+    assert(p->value == arr[i++]);
+    assert(rb_entry(&p->link, struct item, link) == p);
+    assert(&items[p->payload] == p);
+  }
+  assert(i == n);
+  assert(rb_entry(rb_last(&root), struct item, link)->value == arr[n - 1]);
+  assert(rb_prev(rb_first(&root)) == NULL);
+
+  for (i = 0; i < n; i++) {
+    struct item probe = {.value = items[i].value};
+    struct item *p = item_tree_find(&root, &probe);
+    assert(p != NULL && p->value == items[i].value);
+    item_tree_erase(&root, &items[i]);
+    if (i % 64 == 0 && root.root != NULL) {
+      assert(root.root->color == RBTREE_BLACK);
+      link_black_height(root.root, NULL);
+    }
+  }
+  assert(root.root == NULL);
+
+  free(arr);
+  free(items);
+}
+
+static key_t interval_check(const rb_link *p) {
+  if (p == NULL) {
+    return -1;
+  }
+  const rb_interval *n = rb_entry(p, rb_interval, link);
+  key_t m = n->hi, l = interval_check(p->left), r = interval_check(p->right);
+  m = l > m ? l : m;
+  m = r > m ? r : m;
+  assert(n->max_hi == m);
+  return m;
+}
+
+static void interval_compare(const rb_root *root, const rb_interval *items, const bool *live,
+                             const size_t n, const key_t lo, const key_t hi) {
+  size_t expected = 0;
+  for (size_t i = 0; i < n; i++) {
+    expected += live[i] && items[i].lo <= hi && items[i].hi >= lo;
+  }
+  rb_interval **out = calloc(n + 1, sizeof(rb_interval *));
+  size_t found = rbtree_interval_stab(root, lo, hi, out, n);
+  assert(found == expected);
+  for (size_t i = 0; i < found; i++) {
+    assert(out[i]->lo <= hi && out[i]->hi >= lo);
+    assert(live[out[i] - items]);
+    assert(i == 0 || out[i - 1]->lo <= out[i]->lo);
+  }
+  assert((rbtree_interval_overlap(root, lo, hi) != NULL) == (expected > 0));
+  free(out);
+}
+
+// interval tree overlap/stab queries should match a linear scan
+void test_interval(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rb_root root = RB_ROOT_INIT;
+  rb_interval *items = calloc(n, sizeof(rb_interval));
+  bool *live = calloc(n, sizeof(bool));
+  for (int i = 0; i < n; i++) {
+    items[i].lo = rand() % (int)n;
+    items[i].hi = items[i].lo + rand() % 50;
+    rbtree_interval_insert(&root, &items[i]);
+    live[i] = true;
+  }
+  interval_check(root.root);
+  for (int i = 0; i < 100; i++) {
+    key_t lo = rand() % (int)n - 20;
+    interval_compare(&root, items, live, n, lo, lo);            // point stabbing
+    interval_compare(&root, items, live, n, lo, lo + rand() % 30);
+  }
+
+  for (int i = 0; i < n; i += 2) {
+    rbtree_interval_erase(&root, &items[i]);
+    live[i] = false;
+  }
+  interval_check(root.root);
+  for (int i = 0; i < 100; i++) {
+    key_t lo = rand() % (int)n - 20;
+    interval_compare(&root, items, live, n, lo, lo + rand() % 30);
+  }
+  assert(rbtree_interval_overlap(&root, 10, 5) == NULL);
+
+  free(live);
+  free(items);
+}
+
+// parent-pointer-free top-down tree should behave like the sorted multiset
+void test_top_down(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree_td *t = new_rbtree_td();
+  assert(rbtree_td_min(t) == NULL && rbtree_td_max(t) == NULL);
+  assert(rbtree_td_erase(t, 0) == 0);
+
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)(n / 4);  // plenty of duplicates
+    td_node *p = rbtree_td_insert(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+  }
+  assert(rbtree_td_validate(t) == RBTREE_VALID);
+  assert(t->size == n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  rbtree_td_to_array(t, res, n);
+  assert(memcmp(arr, res, n * sizeof(key_t)) == 0);
+  assert(rbtree_td_min(t)->key == arr[0]);
+  assert(rbtree_td_max(t)->key == arr[n - 1]);
+  for (int i = 0; i < n; i++) {
+    td_node *p = rbtree_td_find(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+  }
+
+  // erase every other element (by key), then the iterator sees the rest in order
+  for (int i = 0; i < n; i += 2) {
+    assert(rbtree_td_erase(t, arr[i]) == 1);
+  }
+  assert(rbtree_td_validate(t) == RBTREE_VALID);
+  assert(t->size == n / 2);
+  rbtree_td_iter it;
+  size_t i = 1;
+  for (td_node *p = rbtree_td_first(t, &it); p != NULL; p = rbtree_td_next(&it), i += 2) {
+    assert(p->key == arr[i]);
+  }
+  assert(i == n + 1);
+  assert(rbtree_td_erase(t, -1) == 0);
+
+  for (int i = 1; i < n; i += 2) {
+    assert(rbtree_td_erase(t, arr[i]) == 1);
+    assert(i % 64 != 1 || rbtree_td_validate(t) == RBTREE_VALID);
+  }
+  assert(t->root == NULL && t->size == 0);
+
+  free(res);
+  free(arr);
+  delete_rbtree_td(t);
+}
+
+typedef struct {
+  rbtree_combiner *c;
+  key_t base;
+  int n;
+} combine_arg;
+
+static void *combine_worker(void *p) {
+  combine_arg *a = (combine_arg *)p;
+  const int slot = rbtree_combiner_join(a->c);
+  for (int i = 0; i < a->n; i++) {
+    node_t *q = rbtree_combine_insert(a->c, slot, a->base + i);
+    assert(q != NULL && q->key == a->base + i);
+  }
+  for (int i = 0; i < a->n; i++) {
+    assert(rbtree_combine_find(a->c, slot, a->base + i) != NULL);
+  }
+  // drop the odd keys of this thread's range
+  for (int i = 1; i < a->n; i += 2) {
+    assert(rbtree_combine_erase(a->c, slot, a->base + i) == 1);
+  }
+  assert(rbtree_combine_erase(a->c, slot, a->base + 1) == 0);
+  return NULL;
+}
+
+// concurrent producers through the flat-combining front-end
+void test_combine(const int threads, const int n) {
+  rbtree *t = new_rbtree();
+  rbtree_combiner *c = new_rbtree_combiner(t, threads);
+  pthread_t tid[threads];
+  combine_arg args[threads];
+  for (int i = 0; i < threads; i++) {
+    args[i] = (combine_arg){c, (key_t)i * n, n};
+    pthread_create(&tid[i], NULL, combine_worker, &args[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  assert(c->ops == (size_t)threads * (n + n + n / 2 + 1));
+  assert(c->batches > 0 && c->batches <= c->ops);
+
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_size(t) == (size_t)threads * ((n + 1) / 2));
+  key_t *res = calloc(rbtree_size(t), sizeof(key_t));
+  rbtree_to_array(t, res, rbtree_size(t));
+  for (size_t i = 0; i < rbtree_size(t); i++) {
+    assert(res[i] == (key_t)(2 * i));  // n is even, so the even keys are left
+  }
+  free(res);
+  delete_rbtree_combiner(c);
+  delete_rbtree(t);
+}
+
+// hash-indexed exact lookups must agree with the tree walk
+void test_indexed(const size_t n, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(RBTREE_MODE_INDEXED | mode);
+  rbtree *ref = new_rbtree();
+  assert(rbtree_index_memory(t) == 0);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)(n / 2);
+    rbtree_insert(t, arr[i]);
+    rbtree_insert(ref, arr[i]);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_index_memory(t) >= t->index.used * sizeof(rbtree_index_slot));
+
+  for (key_t k = -1; k <= (key_t)(n / 2); k++) {
+    node_t *p = rbtree_find(t, k);
+    assert((p != NULL) == (rbtree_find(ref, k) != NULL));
+    assert(p == NULL || p->key == k);
+    assert(rbtree_count(t, k) == rbtree_count(ref, k));
+  }
+
+  // erasing whichever node the index points at must move it to a duplicate
+  for (int i = 0; i < n / 2; i++) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+    rbtree_erase(ref, rbtree_find(ref, arr[i]));
+    assert(i % 32 != 0 || rbtree_validate(t) == RBTREE_VALID);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  for (key_t k = -1; k <= (key_t)(n / 2); k++) {
+    assert((rbtree_find(t, k) != NULL) == (rbtree_find(ref, k) != NULL));
+  }
+
+  assert(rbtree_erase_range(t, 0, (key_t)(n / 4)) == rbtree_erase_range(ref, 0, (key_t)(n / 4)));
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_find(t, (key_t)(n / 8)) == NULL);
+  rbtree_erase_min_n(t, rbtree_size(t));
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_index_memory(t) == 0);
+
+  free(arr);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+// incremental compaction keeps the tree intact and packs it in key order
+void test_compact(const size_t n, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(mode);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;
+    rbtree_insert(t, arr[i]);
+  }
+  rbtree_compact_stats st;
+  // a zero budget or an empty tree must not map a slab
+  assert(rbtree_compact(t, 0, &st) == 0 && st.moved == 0);
+  assert(st.pool_bytes == 0 && t->pool.nslabs == 0);
+  rbtree *empty = new_rbtree_mode(mode);
+  assert(rbtree_compact(empty, 16, &st) == 1 && st.pool_bytes == 0);
+  delete_rbtree(empty);
+
+  // churn between small slices, including erasing right at the cursor
+  size_t moved = 0, slices = 0;
+  while (!rbtree_compact(t, 16, &st)) {
+    moved += st.moved;
+    slices++;
+    assert(rbtree_validate(t) == RBTREE_VALID);
+    if (slices % 4 == 0 && t->pool.cursor != t->nil) {
+      rbtree_erase(t, t->pool.cursor);
+    }
+    if (slices % 4 == 1) {
+      rbtree_insert(t, rand() % (int)n);
+    }
+    if (slices % 8 == 2 && t->pool.cursor != t->nil) {
+      rbtree_erase_range(t, t->pool.cursor->key, t->pool.cursor->key + 3);
+    }
+  }
+  moved += st.moved;
+  assert(st.done && moved > 0);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(st.pool_bytes > 0);
+
+  // an undisturbed pass lays every node next to its predecessor
+  assert(rbtree_compact(t, rbtree_size(t), &st) == 1);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(st.reclaimed > 0);
+  assert(st.locality > 0.99);
+  size_t k = rbtree_size(t);
+  rbtree_to_array(t, res, k);
+  for (size_t i = 1; i < k; i++) {
+    assert(res[i - 1] <= res[i]);
+  }
+
+  // nodes in the pool are freed through erase as well
+  while (rbtree_min(t) != NULL) {
+    rbtree_erase(t, rbtree_min(t));
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_compact(t, 16, &st) == 1 && st.moved == 0);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// capacity-bounded tree keeps the k largest keys of a stream
+void test_top_k(const size_t n, const size_t k, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(mode);
+  rbtree_set_capacity(t, k);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(k, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;
+    node_t *min = rbtree_min(t);
+    const int full = rbtree_size(t) == k;
+    const int evicts = full && arr[i] > min->key;
+    const int reuse = evicts && min->count == 1 && rbtree_find(t, arr[i]) == NULL;
+    node_t *p = rbtree_insert(t, arr[i]);
+    if (full && !evicts) {
+      assert(p == NULL);  // rejected against the cached minimum
+    } else {
+      assert(p != NULL && p->key == arr[i]);
+    }
+    assert(!reuse || p == min);  // the evicted node's memory is reused
+    assert(rbtree_size(t) <= k);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  rbtree_to_array(t, res, k);
+  assert(memcmp(res, arr + n - k, k * sizeof(key_t)) == 0);
+
+  // shrinking the capacity drops the smallest keys right away
+  rbtree_set_capacity(t, k / 2);
+  assert(rbtree_size(t) == k / 2);
+  assert(rbtree_min(t)->key == arr[n - k / 2]);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  rbtree_set_capacity(t, 0);
+  assert(rbtree_insert(t, -1) != NULL);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// arena-backed nodes: slab reuse, accounting and NUMA placement requests
+void test_arena(const size_t n, const unsigned int mode, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree_mode(RBTREE_MODE_ARENA | mode);
+  rbtree_memory mu;
+  rbtree_memory_usage(t, &mu);
+  assert(mu.nodes == 0 && mu.slab_bytes == 0 && mu.overhead > 0);
+
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand();
+    rbtree_insert(t, arr[i]);
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  rbtree_memory_usage(t, &mu);
+  assert(mu.nodes == n * sizeof(node_t));
+  assert(mu.slabs > 0 && mu.slab_bytes >= mu.nodes);
+  assert(mu.huge_bytes <= mu.slab_bytes);
+  assert(mu.nodes + mu.fragmentation < mu.slab_bytes);  // the rest are slab headers
+  const size_t slab_bytes = mu.slab_bytes;
+
+  // erased nodes leave holes that later inserts fill before any new slab
+  for (int i = 0; i < n; i += 2) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+  }
+  rbtree_memory_usage(t, &mu);
+  assert(mu.nodes == (n / 2) * sizeof(node_t));
+  assert(mu.fragmentation >= (n / 2) * sizeof(node_t));
+  for (int i = 0; i < n; i += 2) {
+    rbtree_insert(t, arr[i]);
+  }
+  rbtree_memory_usage(t, &mu);
+  assert(mu.slab_bytes == slab_bytes);
+  assert(rbtree_validate(t) == RBTREE_VALID);
+
+  assert(mu.unplaced_bytes == 0);
+
+  // rejected policies and masks leave the old policy in place
+  assert(rbtree_set_numa(t, (rbtree_numa_t)7, 0) == -1);
+  assert(rbtree_set_numa(t, RBTREE_NUMA_LOCAL, 1) == -1);
+  assert(rbtree_set_numa(t, RBTREE_NUMA_BIND, 0) == -1);
+  assert(rbtree_set_numa(t, RBTREE_NUMA_BIND, 1ul << 63) == -1);
+  assert(t->pool.numa_policy == RBTREE_NUMA_DEFAULT);
+
+  // placement is best effort: the tree stays intact whether or not the kernel obeys,
+  // and slabs that could not be placed are reported
+  int r = rbtree_set_numa(t, RBTREE_NUMA_LOCAL, 0);
+  rbtree_memory_usage(t, &mu);
+  assert((r == 0) == (mu.unplaced_bytes == 0));
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, arr[i]);
+  }
+  r = rbtree_set_numa(t, RBTREE_NUMA_INTERLEAVE, 1);
+  while (!rbtree_compact(t, 1000, NULL)) {
+  }
+  assert(rbtree_validate(t) == RBTREE_VALID);
+  assert(rbtree_size(t) == 2 * n);
+  rbtree_memory_usage(t, &mu);
+  assert(mu.nodes == 2 * n * sizeof(node_t));
+  if (t->pool.numa_policy == RBTREE_NUMA_INTERLEAVE) {
+    // compaction moved every node into slabs mapped under the policy
+    assert(mu.unplaced_bytes == 0);
+  } else {
+    assert(r == -1);
+  }
+
+  free(arr);
+  delete_rbtree(t);
+}
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -431,6 +1180,28 @@ int main(void) {
   test_minmax_suite();
   test_to_array_suite();
   test_distinct_values();
+  test_find_many(1000, 29);
+  test_insert_hint(1000, 31);
+  test_counted(1000, 37);
+  test_validate(1000, 41);
+  test_intrusive(1000, 43);
+  test_interval(1000, 67);
+  test_erase_range(1000, 0, 47);
+  test_erase_range(1000, RBTREE_MODE_COUNTED, 53);
+  test_top_down(1000, 71);
+  test_combine(4, 2000);
+  test_indexed(1000, 0, 73);
+  test_indexed(1000, RBTREE_MODE_COUNTED, 79);
+  test_compact(5000, 0, 83);
+  test_compact(5000, RBTREE_MODE_COUNTED | RBTREE_MODE_INDEXED, 89);
+  test_top_k(10000, 100, 0, 97);
+  test_top_k(10000, 100, RBTREE_MODE_COUNTED | RBTREE_MODE_INDEXED, 101);
+  test_arena(5000, 0, 103);
+  test_arena(5000, RBTREE_MODE_HUGEPAGE | RBTREE_MODE_INDEXED, 107);
+#ifdef RBTREE_AUGMENT
+  test_aggregate(1000, 0, 59);
+  test_aggregate(1000, RBTREE_MODE_COUNTED, 61);
+#endif
   //test_duplicate_values();
   //test_multi_instance();
   //test_find_erase_rand(10000, 17);